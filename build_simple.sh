@@ -16,6 +16,7 @@ g++ -std=gnu++11 -DNDEBUG -O3 -Wno-deprecated-declarations $1 $2 $3 \
   src/util/util.cpp  \
   src/util/Timer.cpp \
   src/basic/basic.cpp \
+  src/basic/translate.cpp \
   src/basic/hssp.cpp \
   src/dp/ungapped_align.cpp \
   src/run/tools.cpp \
@@ -35,6 +36,7 @@ g++ -std=gnu++11 -DNDEBUG -O3 -Wno-deprecated-declarations $1 $2 $3 \
   src/output/sam_format.cpp \
   src/align/align.cpp \
   src/search/setup.cpp \
+  src/search/memory_model.cpp \
   src/dp/diag_scores.cpp \
   src/data/taxonomy.cpp \
   src/lib/tantan/tantan.cc \
@@ -59,6 +61,7 @@ g++ -std=gnu++11 -DNDEBUG -O3 -Wno-deprecated-declarations $1 $2 $3 \
   src/util/io/file_sink.cpp \
   src/util/io/file_source.cpp \
   src/util/io/input_file.cpp \
+  src/util/io/mapped_file.cpp \
   src/util/io/input_stream_buffer.cpp \
   src/util/io/output_file.cpp \
   src/util/io/output_stream_buffer.cpp \
@@ -71,15 +74,20 @@ g++ -std=gnu++11 -DNDEBUG -O3 -Wno-deprecated-declarations $1 $2 $3 \
   src/search/stage0.cpp \
   src/util/memory/memory_pool.cpp \
   src/data/seed_array.cpp \
+  src/data/seed_index.cpp \
+  src/data/title_store.cpp \
   src/output/paf_format.cpp \
   src/util/system/system.cpp \
   src/run/cluster.cpp \
+  src/run/serve.cpp \
   src/util/algo/greedy_vortex_cover.cpp \
   src/util/algo/greedy_vortex_cover_weighted.cpp \
   src/util/sequence/sequence.cpp \
   src/tools/tsv_record.cpp \
   src/tools/tools.cpp \
   src/util/system/getRSS.cpp \
+  src/util/system/numa.cpp \
+  src/util/system/huge_pages.cpp \
   src/util/math/sparse_matrix.cpp \
   src/lib/tantan/LambdaCalculator.cc \
   src/data/taxonomy_filter.cpp \
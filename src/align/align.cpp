@@ -17,6 +17,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ****/
 
 #include <memory>
+#include <mutex>
+#include <condition_variable>
 #include "../basic/value.h"
 #include "align.h"
 #include "../data/reference.h"
@@ -25,6 +27,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "../output/output.h"
 #include "query_mapper.h"
 #include "../util/merge_sort.h"
+#include "../search/memory_model.h"
+#include "../util/system/huge_pages.h"
 
 using namespace std;
 
@@ -70,12 +74,103 @@ unique_ptr<Queue> Align_fetcher::queue_;
 vector<hit>::iterator Align_fetcher::it_;
 vector<hit>::iterator Align_fetcher::end_;
 
+// Alignments of representative queries, which are kept until the output of all their
+// duplicates has been generated. The duplicates have no trace points and follow their
+// representative in the query order, so their output is generated from the mapper
+// of the representative once it has been computed.
+struct DedupCache
+{
+	struct Entry
+	{
+		Entry():
+			ready(false),
+			remaining(0)
+		{}
+		shared_ptr<QueryMapper> mapper;
+		bool ready;
+		unsigned remaining;
+		mutex mtx;
+	};
+	static void init()
+	{
+		entries_.reset(query_dedup ? new Entry[query_dedup->representative.size()] : nullptr);
+		if (query_dedup)
+			for (size_t i = 0; i < query_dedup->representative.size(); ++i)
+				entries_[i].remaining = query_dedup->duplicates[i];
+	}
+	static void clear()
+	{
+		entries_.reset();
+	}
+	static bool needed(size_t query)
+	{
+		return query_dedup && query_dedup->duplicates[query] > 0;
+	}
+	// Stores the alignments of a representative. mapper is null if it has no alignments.
+	static void put(size_t query, QueryMapper *mapper)
+	{
+		{
+			lock_guard<mutex> lock(mtx_);
+			entries_[query].mapper.reset(mapper);
+			entries_[query].ready = true;
+		}
+		cv_.notify_all();
+	}
+	static void generate_output(size_t query, Statistics &stat, const Parameters &params, const Metadata &metadata)
+	{
+		const size_t rep = query_dedup->representative[query];
+		Entry &e = entries_[rep];
+		{
+			unique_lock<mutex> lock(mtx_);
+			cv_.wait(lock, [&e]() { return e.ready; });
+		}
+		TextBuffer *buf = 0;
+		{
+			lock_guard<mutex> lock(e.mtx);
+			if (e.mapper) {
+				if (*output_format != Output_format::null) {
+					buf = new TextBuffer;
+					e.mapper->query_id = (unsigned)query;
+					const bool aligned = e.mapper->generate_output(*buf, stat, metadata);
+					e.mapper->query_id = (unsigned)rep;
+					if (aligned && (!config.unaligned.empty() || !config.aligned_file.empty())) {
+						query_aligned_mtx.lock();
+						query_aligned[query] = true;
+						query_aligned_mtx.unlock();
+					}
+				}
+			}
+			else if (!blocked_processing && *output_format != Output_format::daa && config.report_unaligned != 0) {
+				buf = new TextBuffer;
+				const char *query_title = query_ids::get()[query].c_str();
+				output_format->print_query_intro(query, query_title, get_source_query_len((unsigned)query), *buf, true);
+				output_format->print_query_epilog(*buf, query_title, true, params);
+			}
+			if (--e.remaining == 0)
+				e.mapper.reset();
+		}
+		OutputSink::get().push(query, buf);
+	}
+private:
+	static unique_ptr<Entry[]> entries_;
+	static mutex mtx_;
+	static condition_variable cv_;
+};
+
+unique_ptr<DedupCache::Entry[]> DedupCache::entries_;
+mutex DedupCache::mtx_;
+condition_variable DedupCache::cv_;
+
 void align_worker(size_t thread_id, const Parameters *params, const Metadata *metadata)
 {
 	Align_fetcher hits;
 	Statistics stat;
 	DpStat dp_stat;
 	while (hits.get()) {
+		if (query_dedup && query_dedup->duplicate(hits.query)) {
+			DedupCache::generate_output(hits.query, stat, *params, *metadata);
+			continue;
+		}
 		if (hits.end == hits.begin) {
 			TextBuffer *buf = 0;
 			if (!blocked_processing && *output_format != Output_format::daa && config.report_unaligned != 0) {
@@ -85,12 +180,14 @@ void align_worker(size_t thread_id, const Parameters *params, const Metadata *me
 				output_format->print_query_epilog(*buf, query_title, true, *params);
 			}
 			OutputSink::get().push(hits.query, buf);
+			if (DedupCache::needed(hits.query))
+				DedupCache::put(hits.query, nullptr);
 			continue;
 		}
 
 		QueryMapper *mapper;
 		if (config.ext == Config::swipe)
-			mapper = new ExtensionPipeline::Swipe::Pipeline(*params, hits.query, hits.begin, hits.end);
+			mapper = new ExtensionPipeline::Swipe::Pipeline(*params, hits.query, hits.begin, hits.end, dp_stat);
 		else if (config.frame_shift != 0 || config.ext == Config::banded_swipe)
 			mapper = new ExtensionPipeline::BandedSwipe::Pipeline(*params, hits.query, hits.begin, hits.end, dp_stat, hits.target_parallel);
 		else
@@ -111,7 +208,10 @@ void align_worker(size_t thread_id, const Parameters *params, const Metadata *me
 				query_aligned_mtx.unlock();
 			}
 		}
-		delete mapper;
+		if (DedupCache::needed(hits.query))
+			DedupCache::put(hits.query, mapper);
+		else
+			delete mapper;
 		OutputSink::get().push(hits.query, buf);
 		hits.release();
 	}
@@ -121,10 +221,12 @@ void align_worker(size_t thread_id, const Parameters *params, const Metadata *me
 
 void align_queries(Trace_pt_buffer &trace_pts, Consumer* output_file, const Parameters &params, const Metadata &metadata)
 {
-	const size_t max_size = (size_t)std::min(config.chunk_size*1e9 * 9 * 2 / config.lowmem, 2e9);
+	const size_t max_size = MemoryModel::trace_point_bytes(config.chunk_size, config.lowmem);
 	pair<size_t, size_t> query_range;
+	DedupCache::init();
 	while (true) {
 		task_timer timer("Loading trace points", 3);
+		const DtlbMissCounter dtlb_misses(config.verbosity >= 3);
 		Trace_pt_list *v = new Trace_pt_list;
 		statistics.max(Statistics::TEMP_SPACE, trace_pts.load(*v, max_size, query_range));
 		if (query_range.second - query_range.first == 0) {
@@ -154,8 +256,12 @@ void align_queries(Trace_pt_buffer &trace_pts, Consumer* output_file, const Para
 		log_stream << "Net cells = " << dp_stat.net_cells << endl;
 		log_stream << "Net GCUPS = " << (double)dp_stat.net_cells / 1e9 / t << endl;
 		log_stream << "Net GCUPS/thread = " << (double)dp_stat.net_cells / n_threads / 1e9 / t << endl;
+		if (dp_stat.gross_cells > 0)
+			log_stream << "Lane occupancy = " << (double)dp_stat.net_cells / dp_stat.gross_cells << endl;
+		dtlb_misses.report("alignment", log_stream);
 
 		timer.go("Deallocating buffers");
 		delete v;
 	}
+	DedupCache::clear();
 }
\ No newline at end of file
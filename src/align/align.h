@@ -82,11 +82,13 @@ namespace ExtensionPipeline {
 	namespace Swipe {
 		struct Pipeline : public QueryMapper
 		{
-			Pipeline(const Parameters &params, size_t query_id, Trace_pt_list::iterator begin, Trace_pt_list::iterator end) :
-				QueryMapper(params, query_id, begin, end)
+			Pipeline(const Parameters &params, size_t query_id, Trace_pt_list::iterator begin, Trace_pt_list::iterator end, DpStat &dp_stat) :
+				QueryMapper(params, query_id, begin, end),
+				dp_stat(dp_stat)
 			{}
 			virtual void run(Statistics &stat);
 			virtual ~Pipeline() {}
+			DpStat &dp_stat;
 		};
 	}
 	namespace BandedSwipe {
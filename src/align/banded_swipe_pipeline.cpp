@@ -154,7 +154,7 @@ void Pipeline::run_swipe(bool score_only)
 		banded_3frame_swipe(translated_query, REVERSE, vr.begin(), vr.end(), this->dp_stat, score_only, target_parallel);
 	}
 	else {
-		DP::BandedSwipe::swipe(query_seq(0), vf.begin(), vf.end());
+		DP::BandedSwipe::swipe(query_seq(0), vf.begin(), vf.end(), this->dp_stat);
 	}
 }
 
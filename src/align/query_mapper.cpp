@@ -228,7 +228,7 @@ bool QueryMapper::generate_output(TextBuffer &buffer, Statistics &stat, const Me
 
 		const size_t subject_id = targets[i].subject_id;
 		const unsigned subject_len = (unsigned)ref_seqs::get()[subject_id].length();
-		const char *ref_title = ref_ids::get()[subject_id].c_str();
+		const char *ref_title = ref_ids::title(subject_id);
 		targets[i].apply_filters(source_query_len, subject_len, query_title, ref_title);
 		if (targets[i].hsps.size() == 0)
 			continue;
@@ -16,6 +16,7 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ****/
 
+#include <algorithm>
 #include "align.h"
 #include "query_mapper.h"
 #include "../data/reference.h"
@@ -24,15 +25,22 @@ namespace ExtensionPipeline { namespace Swipe {
 
 void Pipeline::run(Statistics &stat)
 {
+	static thread_local vector<size_t> order;
+	static thread_local vector<sequence> seqs;
 	const size_t n = targets.size();
-	vector<sequence> seqs(n);
+	const Sequence_set &ref = ref_seqs::get();
+	order.resize(n);
+	for (size_t i = 0; i < n; ++i)
+		order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [this, &ref](size_t a, size_t b) { return ref.length(targets[a].subject_id) > ref.length(targets[b].subject_id); });
+	seqs.clear();
+	for (size_t i = 0; i < n; ++i)
+		seqs.push_back(ref[targets[order[i]].subject_id]);
+	vector<int> scores = DP::Swipe::swipe(query_seq(0), seqs.data(), seqs.data() + seqs.size(), dp_stat);
 	for (size_t i = 0; i < n; ++i) {
-		seqs[i] = ref_seqs::get()[targets[i].subject_id];
-	}
-	vector<int> scores = DP::Swipe::swipe(query_seq(0), seqs.data(), seqs.data() + seqs.size());
-	for (size_t i = 0; i < n; ++i) {
-		targets[i].hsps.push_back(Hsp(scores[i]));
-		targets[i].hsps.back().frame = 0;
+		Target &t = targets[order[i]];
+		t.hsps.push_back(Hsp(scores[i]));
+		t.hsps.back().frame = 0;
 	}
 }
 
@@ -248,6 +248,12 @@ void Translator::init(unsigned id)
 			if (equal(lookupReverse[i][j], 4))
 				lookupReverse[i][j][4] = lookupReverse[i][j][0];
 		}
+	for (unsigned i = 0; i < 4; ++i)
+		for (unsigned j = 0; j < 4; ++j)
+			for (unsigned k = 0; k < 4; ++k) {
+				lookup64[i * 16 + j * 4 + k] = lookup[i][j][k];
+				lookupReverse64[i * 16 + j * 4 + k] = lookupReverse[i][j][k];
+			}
 }
 
 vector<Letter> sequence::from_string(const char* str, const Value_traits &vt)
@@ -72,7 +72,8 @@ Config::Config(int argc, const char **argv)
 		.add_command("translate", "")
 		.add_command("filter-blasttab", "")
 		.add_command("show-cbs", "")
-		.add_command("simulate-seqs", "");
+		.add_command("simulate-seqs", "")
+		.add_command("serve", "Keep a DIAMOND database in memory and align query batches received over a socket, FIFO or stdin");
 
 	Options_group general("General options");
 	general.add()
@@ -128,7 +129,10 @@ Config::Config(int argc, const char **argv)
 
 	Options_group makedb("Makedb options");
 	makedb.add()
-		("in", 0, "input reference file in FASTA format", input_ref_file);
+		("in", 0, "input reference file in FASTA format", input_ref_file)
+		("seed-index", 0, "build a precomputed seed index for the alignment commands", seed_index)
+		("pack", 0, "store the sequences 5-bit packed (database format version 5)", pack_seqs)
+		("volume-size", 0, "split the database into volumes of this many billions of letters", volume_size);
 
 	Options_group aligner("Aligner options");
 	aligner.add()
@@ -152,6 +156,7 @@ Config::Config(int argc, const char **argv)
 		("more-sensitive", 0, "enable more sensitive mode (default: fast)", mode_more_sensitive)
 		("block-size", 'b', "sequence block size in billions of letters (default=2.0)", chunk_size)
 		("index-chunks", 'c', "number of chunks for index processing", lowmem)
+		("memory-limit", 0, "memory limit in GB for choosing the block size and number of index chunks", memory_limit)
 		("tmpdir", 't', "directory for temporary files", tmpdir)
 		("gapopen", 0, "gap open penalty", gap_open, -1)
 		("gapextend", 0, "gap extension penalty", gap_extend, -1)
@@ -201,7 +206,17 @@ Config::Config(int argc, const char **argv)
 		("stop-match-score", 0, "Set the match score of stop codons against each other.", stop_match_score, 1)
 		("tantan-minMaskProb", 0, "minimum repeat probability for masking (0.9)", tantan_minMaskProb, 0.9)
 		("tantan-maxRepeatOffset", 0, "maximum tandem repeat period to consider (50)", tantan_maxRepeatOffset, 15)
-		("tantan-ungapped", 0, "use tantan masking in ungapped mode", tantan_ungapped);
+		("tantan-ungapped", 0, "use tantan masking in ungapped mode", tantan_ungapped)
+		("mmap", 0, "memory-map the database file instead of reading reference blocks", mmap_db)
+		("prefetch-memory", 0, "memory in GB that may be used to load the next reference block in the background (default=0)", prefetch_memory)
+		("query-prefetch-memory", 0, "memory in GB that may be used to load the next query chunk in the background (default=0)", query_prefetch_memory)
+		("index-prefetch-memory", 0, "memory in GB that may be used to build the seed arrays of the next shape or index chunk in the background (default=0)", index_prefetch_memory)
+		("numa", 0, "place the seed partitions on the NUMA nodes and pin the search threads to them (Linux)", numa)
+		("huge-pages", 0, "back the seed arrays, hash tables and trace points with transparent huge pages (Linux)", huge_pages)
+		("minimizer-window", 0, "index only the window minimizers of the reference seeds for the given window size, which reduces the reference seeds to about 2/(window+1) at the cost of sensitivity (default=off)", minimizer_window)
+		("fused-seeds", 0, "build reference seed arrays in a single pass over the sequences, which is faster with several index chunks but needs memory for a second copy of the seed array", fused_seeds)
+		("dedup", 0, "search identical query sequences only once and report the alignments for each of them", query_dedup)
+		("volumes", 0, "numbers of the database volumes to search (default=all)", volumes);
 
 	Options_group view_options("View options");
 	view_options.add()
@@ -212,6 +227,15 @@ Config::Config(int argc, const char **argv)
 	getseq_options.add()
 		("seq", 0, "Sequence numbers to display.", seq_no);
 
+	Options_group serve_options("Serve options");
+	serve_options.add()
+		("socket", 0, "Unix domain socket to accept query batches on", serve_socket)
+		("fifo", 0, "path prefix of the FIFOs to read query batches from (.in) and write results to (.out)", serve_fifo)
+		("serve-mode", 0, "alignment mode (blastp/blastx, default=blastp)", serve_mode, string("blastp"))
+		("stream", 0, "align queries read from the query file or stdin in micro-batches and write the results to the output file or stdout", serve_stream)
+		("max-latency", 0, "maximum time in seconds that a query waits for its micro-batch to be searched in stream mode (default=1.0)", max_latency, 1.0)
+		("connections", 0, "maximum number of socket connections that are served at the same time (default=4)", serve_connections, 4u);
+
 	Options_group hidden_options("");
 	hidden_options.add()
 		("extend-all", 0, "extend all seed hits", extend_all)
@@ -263,6 +287,8 @@ Config::Config(int argc, const char **argv)
 		("no-traceback", 0, "", disable_traceback)
 		("family-counts", 0, "", family_counts_file)
 		("radix-cluster-buffered", 0, "", radix_cluster_buffered)
+		("streaming-seeds", 0, "", streaming_seeds)
+		("bloom-seeds", 0, "", bloom_seeds)
 		("join-split-size", 0, "", join_split_size, 100000u)
 		("join-split-key-len", 0, "", join_split_key_len, 17u)
 		("radix-bits", 0, "", radix_bits, 8u)
@@ -280,7 +306,7 @@ Config::Config(int argc, const char **argv)
 		("no-unlink", 0, "", no_unlink)
 		("no-dict", 0, "", no_dict);
 		
-	parser.add(general).add(makedb).add(aligner).add(advanced).add(view_options).add(getseq_options).add(hidden_options);
+	parser.add(general).add(makedb).add(aligner).add(advanced).add(view_options).add(getseq_options).add(serve_options).add(hidden_options);
 	parser.store(argc, argv, command);
 
 	if (long_reads) {
@@ -295,8 +321,10 @@ Config::Config(int argc, const char **argv)
 	case Config::makedb:
 		if (database == "")
 			throw std::runtime_error("Missing parameter: database file (--db/-d)");
-		if (chunk_size != 0.0)
+		if (chunk_size != 0.0 && !seed_index)
 			throw std::runtime_error("Invalid option: --block-size/-b. Block size is set for the alignment commands.");
+		if (volume_size != 0.0 && seed_index)
+			throw std::runtime_error("Options --volume-size and --seed-index cannot be used together.");
 		break;
 	case Config::blastp:
 	case Config::blastx:
@@ -319,6 +347,22 @@ Config::Config(int argc, const char **argv)
 	case Config::view:
 		if (daa_file == "")
 			throw std::runtime_error("Missing parameter: DAA file (--daa/-a)");
+		break;
+	case Config::serve:
+		if (database == "")
+			throw std::runtime_error("Missing parameter: database file (--db/-d)");
+		if ((int)!serve_socket.empty() + (int)!serve_fifo.empty() + (int)serve_stream != 1)
+			throw std::runtime_error("The serve command requires one of the options --socket, --fifo and --stream.");
+		if (max_latency <= 0.0)
+			throw std::runtime_error("Invalid value for parameter --max-latency");
+		if (serve_connections == 0)
+			throw std::runtime_error("Invalid value for parameter --connections");
+		if (serve_mode != "blastp" && serve_mode != "blastx")
+			throw std::runtime_error("Invalid value for parameter --serve-mode");
+		if (output_format.size() > 0 && (output_format[0] == "daa" || output_format[0] == "100"))
+			throw std::runtime_error("DAA format is not supported by the serve command.");
+		if (!taxonlist.empty())
+			throw std::runtime_error("Option --taxonlist is not supported by the serve command.");
 	default:
 		;
 	}
@@ -389,6 +433,7 @@ Config::Config(int argc, const char **argv)
 	case Config::blastx:
 	case Config::view:
 	case Config::cluster:
+	case Config::serve:
 		message_stream << "#CPU threads: " << threads_ << endl;
 	default:
 		;
@@ -403,10 +448,13 @@ Config::Config(int argc, const char **argv)
 	case Config::mask:
 	case Config::makedb:
 	case Config::cluster:
-		if (frame_shift != 0 && command == Config::blastp)
+	case Config::serve:
+		if (frame_shift != 0 && (command == Config::blastp || (command == Config::serve && serve_mode == "blastp")))
 			throw std::runtime_error("Frameshift alignments are only supported for translated searches.");
 		if (query_range_culling && frame_shift == 0)
 			throw std::runtime_error("Query range culling is only supported in frameshift alignment mode (option -F).");
+		if (query_dedup && (frame_shift != 0 || no_self_hits))
+			throw std::runtime_error("Query deduplication is not supported in frameshift alignment mode or with --no-self-hits.");
 		if (matrix_file == "")
 			score_matrix = Score_matrix(to_upper_case(matrix), gap_open, gap_extend, frame_shift, stop_match_score);
 		else {
@@ -422,7 +470,7 @@ Config::Config(int argc, const char **argv)
 	}
 
 	if (command == Config::blastp || command == Config::blastx || command == Config::benchmark || command == Config::model_sim || command == Config::opt
-		|| command == Config::mask || command == Config::cluster) {
+		|| command == Config::mask || command == Config::cluster || command == Config::serve) {
 		if (tmpdir == "")
 			tmpdir = extract_dir(output_file);
 		
@@ -433,7 +481,7 @@ Config::Config(int argc, const char **argv)
 
 	Translator::init(query_gencode);
 
-	if (command == blastx)
+	if (command == blastx || (command == serve && serve_mode == "blastx"))
 		input_value_traits = nucleotide_traits;
 
 	if (command == help)
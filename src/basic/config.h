@@ -151,6 +151,8 @@ struct Config
 	string family_counts_file;
 	string taxonlist;
 	bool radix_cluster_buffered;
+	bool streaming_seeds;
+	bool bloom_seeds;
 	unsigned join_split_size;
 	unsigned join_split_key_len;
 	unsigned radix_bits;
@@ -181,11 +183,31 @@ struct Config
 	int tantan_maxRepeatOffset;
 	bool tantan_ungapped;
 	string taxon_exclude;
+	bool mmap_db;
+	bool seed_index;
+	bool pack_seqs;
+	double prefetch_memory;
+	double query_prefetch_memory;
+	double index_prefetch_memory;
+	bool numa;
+	bool huge_pages;
+	unsigned minimizer_window;
+	bool query_dedup;
+	bool fused_seeds;
+	double memory_limit;
+	double volume_size;
+	vector<string> volumes;
+	string serve_socket;
+	string serve_fifo;
+	string serve_mode;
+	bool serve_stream;
+	double max_latency;
+	unsigned serve_connections;
 
 	enum {
 		makedb = 0, blastp = 1, blastx = 2, view = 3, help = 4, version = 5, getseq = 6, benchmark = 7, random_seqs = 8, compare = 9, sort = 10, roc = 11, db_stat = 12, model_sim = 13,
 		match_file_stat = 14, model_seqs = 15, opt = 16, mask = 17, fastq2fasta = 18, dbinfo = 19, test_extra = 20, test_io = 21, db_annot_stats = 22, read_sim = 23, info = 24, seed_stat = 25,
-		smith_waterman = 26, protein_snps = 27, cluster = 28, translate = 29, filter_blasttab = 30, show_cbs = 31, simulate_seqs = 32
+		smith_waterman = 26, protein_snps = 27, cluster = 28, translate = 29, filter_blasttab = 30, show_cbs = 31, simulate_seqs = 32, serve = 33
 	};
 	unsigned	command;
 
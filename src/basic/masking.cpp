@@ -99,13 +99,13 @@ void mask_worker(Atomic<size_t> *next, Sequence_set *seqs, const Masking *maskin
 			masking->mask_bit(seqs->ptr(i), seqs->length(i));
 }
 
-size_t mask_seqs(Sequence_set &seqs, const Masking &masking, bool hard_mask)
+size_t mask_seqs(Sequence_set &seqs, const Masking &masking, bool hard_mask, size_t threads)
 {
-	vector<thread> threads;
+	vector<thread> workers;
 	Atomic<size_t> next(0);
-	for (size_t i = 0; i < config.threads_; ++i)
-		threads.emplace_back(mask_worker, &next, &seqs, &masking, hard_mask);
-	for (auto &t : threads)
+	for (size_t i = 0; i < (threads == 0 ? config.threads_ : threads); ++i)
+		workers.emplace_back(mask_worker, &next, &seqs, &masking, hard_mask);
+	for (auto &t : workers)
 		t.join();
 	size_t n = 0;
 	for (size_t i = 0; i < seqs.get_length(); ++i)
@@ -41,4 +41,5 @@ private:
 	char mask_table_x_[size], mask_table_bit_[size];
 };
 
-size_t mask_seqs(Sequence_set &seqs, const Masking &masking, bool hard_mask = true);
\ No newline at end of file
+// Masks the sequences using the given number of threads, or config.threads_ if it is 0.
+size_t mask_seqs(Sequence_set &seqs, const Masking &masking, bool hard_mask = true, size_t threads = 0);
\ No newline at end of file
@@ -23,6 +23,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "value.h"
 #include "../util/binary_buffer.h"
 #include "sequence.h"
+#include "../util/simd.h"
 
 using std::vector;
 
@@ -106,4 +107,50 @@ private:
 
 };
 
+// Packed database sequences are a continuous 5-bit stream in the bit order
+// used by Packed_sequence, so that every 8 letters occupy 5 bytes.
+enum { PACKED_GROUP_LETTERS = 8, PACKED_GROUP_BYTES = 5 };
+
+inline void pack_5bit(const Letter *src, size_t groups, uint8_t *dst)
+{
+	for (size_t i = 0; i < groups; ++i) {
+		uint64_t x = 0;
+		for (unsigned j = 0; j < PACKED_GROUP_LETTERS; ++j)
+			x |= uint64_t(src[j] & 31) << (5 * j);
+		for (unsigned j = 0; j < PACKED_GROUP_BYTES; ++j)
+			dst[j] = uint8_t(x >> (8 * j));
+		src += PACKED_GROUP_LETTERS;
+		dst += PACKED_GROUP_BYTES;
+	}
+}
+
+inline void unpack_5bit(const uint8_t *src, size_t groups, Letter *dst)
+{
+#ifdef __SSSE3__
+	// Each 16 bit lane receives the two bytes that hold one letter and is shifted
+	// left so that the letter ends up in the top 5 bits.
+	const __m128i shuffle0 = _mm_setr_epi8(0, 1, 0, 1, 1, 2, 1, 2, 2, 3, 3, 4, 3, 4, 4, 5),
+		shuffle1 = _mm_setr_epi8(5, 6, 5, 6, 6, 7, 6, 7, 7, 8, 8, 9, 8, 9, 9, 10),
+		shift = _mm_setr_epi16(1 << 11, 1 << 6, 1 << 9, 1 << 4, 1 << 7, 1 << 10, 1 << 5, 1 << 8);
+	while (groups >= 4) {
+		const __m128i in = _mm_loadu_si128((const __m128i*)src);
+		const __m128i lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_shuffle_epi8(in, shuffle0), shift), 11),
+			hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_shuffle_epi8(in, shuffle1), shift), 11);
+		_mm_storeu_si128((__m128i*)dst, _mm_packus_epi16(lo, hi));
+		src += 2 * PACKED_GROUP_BYTES;
+		dst += 2 * PACKED_GROUP_LETTERS;
+		groups -= 2;
+	}
+#endif
+	for (size_t i = 0; i < groups; ++i) {
+		uint64_t x = 0;
+		for (unsigned j = 0; j < PACKED_GROUP_BYTES; ++j)
+			x |= uint64_t(src[j]) << (8 * j);
+		for (unsigned j = 0; j < PACKED_GROUP_LETTERS; ++j)
+			dst[j] = Letter((x >> (5 * j)) & 31);
+		src += PACKED_GROUP_BYTES;
+		dst += PACKED_GROUP_LETTERS;
+	}
+}
+
 #endif /* PACKED_SEQUENCE_H_ */
@@ -0,0 +1,168 @@
+/****
+DIAMOND protein aligner
+Copyright (C) 2013-2019 Benjamin Buchfink <buchfink@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+****/
+
+#include <thread>
+#include "translate.h"
+#include "config.h"
+#include "../util/simd.h"
+
+using std::thread;
+
+Letter Translator::lookup64[64];
+Letter Translator::lookupReverse64[64];
+
+#ifdef __SSSE3__
+static inline __m128i lookup_codons(__m128i idx, const Letter *table)
+{
+	const __m128i hi = _mm_srli_epi16(_mm_and_si128(idx, _mm_set1_epi8(0x30)), 4);
+	__m128i r = _mm_setzero_si128();
+	for (int i = 0; i < 4; ++i) {
+		const __m128i t = _mm_loadu_si128((const __m128i*)(table + 16 * i));
+		r = _mm_or_si128(r, _mm_and_si128(_mm_shuffle_epi8(t, idx), _mm_cmpeq_epi8(hi, _mm_set1_epi8(i))));
+	}
+	return r;
+}
+#endif
+
+// Looks up the forward and reverse complement codons starting at each position.
+static void translate_positions(const Letter *dna, size_t n, Letter *fwd, Letter *rev)
+{
+	size_t p = 0;
+#ifdef __SSSE3__
+	const __m128i max_letter = _mm_set1_epi8(3);
+	for (; p + 16 <= n; p += 16) {
+		const __m128i a = _mm_loadu_si128((const __m128i*)(dna + p)),
+			b = _mm_loadu_si128((const __m128i*)(dna + p + 1)),
+			c = _mm_loadu_si128((const __m128i*)(dna + p + 2));
+		if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_max_epu8(_mm_max_epu8(a, b), c), max_letter)) != 0) {
+			for (size_t i = p; i < p + 16; ++i) {
+				fwd[i] = Translator::lookup[(int)dna[i]][(int)dna[i + 1]][(int)dna[i + 2]];
+				rev[i] = Translator::lookupReverse[(int)dna[i + 2]][(int)dna[i + 1]][(int)dna[i]];
+			}
+			continue;
+		}
+		const __m128i b4 = _mm_slli_epi16(b, 2),
+			f = _mm_add_epi8(_mm_add_epi8(_mm_slli_epi16(a, 4), b4), c),
+			r = _mm_add_epi8(_mm_add_epi8(_mm_slli_epi16(c, 4), b4), a);
+		_mm_storeu_si128((__m128i*)(fwd + p), lookup_codons(_mm_and_si128(f, _mm_set1_epi8(63)), Translator::lookup64));
+		_mm_storeu_si128((__m128i*)(rev + p), lookup_codons(_mm_and_si128(r, _mm_set1_epi8(63)), Translator::lookupReverse64));
+	}
+#endif
+	for (; p < n; ++p) {
+		fwd[p] = Translator::lookup[(int)dna[p]][(int)dna[p + 1]][(int)dna[p + 2]];
+		rev[p] = Translator::lookupReverse[(int)dna[p + 2]][(int)dna[p + 1]][(int)dna[p]];
+	}
+}
+
+// Extracts a frame from the codons at every position, starting at first and
+// stepping by step, with the last letter taken from the codon at last, and
+// returns if the frame has a stop-free run of at least run_len.
+static bool extract_frame(const Letter *codons, ptrdiff_t first, ptrdiff_t step, size_t n, ptrdiff_t last, Letter *dst, unsigned run_len)
+{
+	unsigned run = 0;
+	bool good = false;
+	const Letter *p = codons + first;
+	for (size_t i = 0; i < n; ++i, p += step) {
+		const Letter l = i + 1 < n ? *p : codons[last];
+		dst[i] = l;
+		if (l == Translator::STOP) {
+			good |= run >= run_len;
+			run = 0;
+		}
+		else
+			++run;
+	}
+	return good || run >= run_len;
+}
+
+size_t Translator::translate(const sequence &dna, vector<Letter> *proteins, unsigned run_len, unsigned &good_frames, vector<Letter> &buf)
+{
+	const size_t len = dna.length();
+	good_frames = 0;
+	if (len < 3) {
+		for (unsigned i = 0; i < 6; ++i)
+			proteins[i].clear();
+		return 0;
+	}
+	const size_t positions = len - 2;
+	buf.resize(2 * positions);
+	Letter *fwd = buf.data(), *rev = fwd + positions;
+	translate_positions(dna.data(), positions, fwd, rev);
+	size_t n = 0;
+	for (unsigned f = 0; f < 3; ++f) {
+		const size_t d = (len - f) / 3;
+		proteins[f].resize(d);
+		proteins[3 + f].resize(d);
+		if (d == 0)
+			continue;
+		const ptrdiff_t first_rev = (ptrdiff_t)(len - 3 - f), last_rev = first_rev - 3 * (ptrdiff_t)(d - 1);
+		if (extract_frame(fwd, f, 3, d, f + 3 * (d - 1), proteins[f].data(), run_len))
+			good_frames |= 1 << f;
+		// Like translate(vector), the last codon of the second reverse frame is read
+		// from position 1 if the length is 1 mod 3.
+		if (extract_frame(rev, first_rev, -3, d, f == 1 && len % 3 == 1 ? 1 : last_rev, proteins[3 + f].data(), run_len))
+			good_frames |= 1 << (3 + f);
+		n += 2 * d;
+	}
+	return n;
+}
+
+void FrameTranslations::translate(const vector<sequence> &seqs, unsigned threads)
+{
+	entries_.resize(seqs.size());
+	size_t letters = 0;
+	for (const sequence &s : seqs)
+		letters += s.length();
+	const size_t parts = std::max(std::min((size_t)threads, seqs.size()), (size_t)1);
+	parts_.resize(parts);
+	vector<thread> workers;
+	size_t begin = 0, sum = 0;
+	for (size_t i = 0; i < parts; ++i) {
+		size_t end = begin;
+		const size_t target = letters / parts * (i + 1);
+		while (end < seqs.size() && (sum < target || i + 1 == parts)) {
+			sum += seqs[end].length();
+			++end;
+		}
+		if (i + 1 < parts)
+			workers.emplace_back(&FrameTranslations::translate_part, this, &seqs, begin, end, i);
+		else
+			translate_part(&seqs, begin, end, i);
+		begin = end;
+	}
+	for (thread &t : workers)
+		t.join();
+}
+
+void FrameTranslations::translate_part(const vector<sequence> *seqs, size_t begin, size_t end, size_t part)
+{
+	vector<Letter> &out = parts_[part];
+	vector<Letter> buf, proteins[6];
+	out.clear();
+	for (size_t i = begin; i < end; ++i) {
+		const sequence &s = (*seqs)[i];
+		Entry &e = entries_[i];
+		e.part = part;
+		Translator::translate(s, proteins, config.get_run_len((unsigned)s.length() / 3), e.good_frames, buf);
+		e.begin[0] = out.size();
+		for (unsigned f = 0; f < 6; ++f) {
+			out.insert(out.end(), proteins[f].begin(), proteins[f].end());
+			e.begin[f + 1] = out.size();
+		}
+	}
+}
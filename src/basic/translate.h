@@ -21,6 +21,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <vector>
 #include "value.h"
+#include "sequence.h"
 
 using std::vector;
 
@@ -32,6 +33,9 @@ public:
 	static const Letter reverseLetter[5];
 	static Letter lookup[5][5][5];
 	static Letter lookupReverse[5][5][5];
+	// Codon tables for sequences without N, indexed by 16*a+4*b+c for the forward
+	// codon abc and by 16*c+4*b+a for the reverse complement codon of abc.
+	static Letter lookup64[64], lookupReverse64[64];
 	static const Letter STOP;
 	static const char* codes[27];
 
@@ -146,6 +150,51 @@ public:
 			mask_runs(queries[i], run_len);
 	}
 
+	// Translates the six frames like translate() and sets the frames that
+	// computeGoodFrames would return in good_frames. The codons at all positions
+	// are looked up with SIMD shuffles, and the stop codon runs are counted while
+	// the frames are extracted. buf is used as scratch space.
+	static size_t translate(const sequence &dna, vector<Letter> *proteins, unsigned run_len, unsigned &good_frames, vector<Letter> &buf);
+
+};
+
+// Six-frame translations of a set of sequences, which are computed on several threads.
+struct FrameTranslations
+{
+
+	// Translates the sequences using config.get_run_len to determine the good frames.
+	void translate(const vector<sequence> &seqs, unsigned threads);
+
+	sequence frame(size_t i, unsigned frame) const
+	{
+		const Entry &e = entries_[i];
+		return sequence(parts_[e.part].data() + e.begin[frame], e.begin[frame + 1] - e.begin[frame]);
+	}
+
+	unsigned good_frames(size_t i) const
+	{
+		return entries_[i].good_frames;
+	}
+
+	// Total number of letters of the six frames.
+	size_t letters(size_t i) const
+	{
+		return entries_[i].begin[6] - entries_[i].begin[0];
+	}
+
+private:
+
+	struct Entry
+	{
+		size_t part, begin[7];
+		unsigned good_frames;
+	};
+
+	void translate_part(const vector<sequence> *seqs, size_t begin, size_t end, size_t part);
+
+	vector<Entry> entries_;
+	vector<vector<Letter>> parts_;
+
 };
 
 #endif /* TRANSLATE_H_ */
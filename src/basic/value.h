@@ -69,6 +69,17 @@ struct Char_representation
 			throw invalid_sequence_char_exception(c);
 		return data_[(long)c];
 	}
+	// Converts the characters without throwing. Returns false if any of them is invalid.
+	bool convert(const char *begin, const char *end, Letter *dst) const
+	{
+		Letter invalid_mask = 0;
+		for (; begin < end; ++begin, ++dst) {
+			const Letter l = data_[(uint8_t)*begin];
+			*dst = l;
+			invalid_mask |= Letter(l == invalid);
+		}
+		return invalid_mask == 0;
+	}
 private:
 	static const char invalid;
 	Letter data_[256];
@@ -33,12 +33,13 @@ using namespace std;
 const double Frequent_seeds::hash_table_factor = 1.3;
 Frequent_seeds frequent_seeds;
 
-void Frequent_seeds::compute_sd(Atomic<unsigned> *seedp, DoubleArray<SeedArray::_pos> *query_seed_hits, DoubleArray<SeedArray::_pos> *ref_seed_hits, vector<Sd> *ref_out, vector<Sd> *query_out)
+template<typename _pos>
+void Frequent_seeds::compute_sd(Atomic<unsigned> *seedp, DoubleArray<_pos> *query_seed_hits, DoubleArray<_pos> *ref_seed_hits, vector<Sd> *ref_out, vector<Sd> *query_out)
 {
 	unsigned p;
 	while ((p = (*seedp)++) < current_range.end()) {
 		Sd ref_sd, query_sd;
-		for (auto it = JoinIterator<SeedArray::_pos>(query_seed_hits[p].begin(), ref_seed_hits[p].begin()); it; ++it) {
+		for (auto it = JoinIterator<_pos>(query_seed_hits[p].begin(), ref_seed_hits[p].begin()); it; ++it) {
 			query_sd.add((double)it.r->size());
 			ref_sd.add((double)it.s->size());
 		}
@@ -47,11 +48,12 @@ void Frequent_seeds::compute_sd(Atomic<unsigned> *seedp, DoubleArray<SeedArray::
 	}
 }
 
+template<typename _pos>
 void Frequent_seeds::build_worker(
 	size_t seedp,
 	size_t thread_id,
-	DoubleArray<SeedArray::_pos> *query_seed_hits,
-	DoubleArray<SeedArray::_pos> *ref_seed_hits,
+	DoubleArray<_pos> *query_seed_hits,
+	DoubleArray<_pos> *ref_seed_hits,
 	const SeedPartitionRange *range,
 	unsigned sid,
 	unsigned ref_max_n,
@@ -62,7 +64,7 @@ void Frequent_seeds::build_worker(
 
 	vector<uint32_t> buf;
 	size_t n = 0;
-	for (auto it = JoinIterator<SeedArray::_pos>(query_seed_hits[seedp].begin(), ref_seed_hits[seedp].begin()); it;) {
+	for (auto it = JoinIterator<_pos>(query_seed_hits[seedp].begin(), ref_seed_hits[seedp].begin()); it;) {
 		if (it.s->size() > ref_max_n || it.r->size() > query_max_n) {
 			n += (unsigned)it.s->size();
 			Packed_seed s;
@@ -91,13 +93,14 @@ void Frequent_seeds::build_worker(
 	(*counts)[seedp] = (unsigned)n;
 }
 
-void Frequent_seeds::build(unsigned sid, const SeedPartitionRange &range, DoubleArray<SeedArray::_pos> *query_seed_hits, DoubleArray<SeedArray::_pos> *ref_seed_hits)
+template<typename _pos>
+void Frequent_seeds::build(unsigned sid, const SeedPartitionRange &range, DoubleArray<_pos> *query_seed_hits, DoubleArray<_pos> *ref_seed_hits)
 {
 	vector<Sd> ref_sds(range.size()), query_sds(range.size());
 	Atomic<unsigned> seedp(range.begin());
 	vector<thread> threads;
 	for (unsigned i = 0; i < config.threads_; ++i)
-		threads.emplace_back(compute_sd, &seedp, query_seed_hits, ref_seed_hits, &ref_sds, &query_sds);
+		threads.emplace_back(compute_sd<_pos>, &seedp, query_seed_hits, ref_seed_hits, &ref_sds, &query_sds);
 	for (auto &t : threads)
 		t.join();
 
@@ -107,6 +110,9 @@ void Frequent_seeds::build(unsigned sid, const SeedPartitionRange &range, Double
 	log_stream << "Seed frequency mean (query) = " << query_sd.mean() << ", SD = " << query_sd.sd() << endl;
 	log_stream << "Seed frequency cap query: " << query_max_n << ", reference: " << ref_max_n << endl;
 	vector<unsigned> counts(Const::seedp);
-	Util::Parallel::scheduled_thread_pool_auto(config.threads_, Const::seedp, build_worker, query_seed_hits, ref_seed_hits, &range, sid, ref_max_n, query_max_n, &counts);
+	Util::Parallel::scheduled_thread_pool_auto(config.threads_, Const::seedp, build_worker<_pos>, query_seed_hits, ref_seed_hits, &range, sid, ref_max_n, query_max_n, &counts);
 	log_stream << "Masked positions = " << std::accumulate(counts.begin(), counts.end(), 0) << std::endl;
-}
\ No newline at end of file
+}
+
+template void Frequent_seeds::build<Packed_loc>(unsigned, const SeedPartitionRange &, DoubleArray<Packed_loc> *, DoubleArray<Packed_loc> *);
+template void Frequent_seeds::build<uint32_t>(unsigned, const SeedPartitionRange &, DoubleArray<uint32_t> *, DoubleArray<uint32_t> *);
\ No newline at end of file
@@ -28,7 +28,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 struct Frequent_seeds
 {
 
-	void build(unsigned sid, const SeedPartitionRange &range, DoubleArray<SeedArray::_pos> *query_seed_hits, DoubleArray<SeedArray::_pos> *ref_seed_hits);
+	template<typename _pos>
+	void build(unsigned sid, const SeedPartitionRange &range, DoubleArray<_pos> *query_seed_hits, DoubleArray<_pos> *ref_seed_hits);
 
 	bool get(const Letter *pos, unsigned sid) const
 	{
@@ -43,18 +44,20 @@ private:
 
 	static const double hash_table_factor;   
 
+	template<typename _pos>
 	static void build_worker(
 		size_t seedp,
 		size_t thread_id,
-		DoubleArray<SeedArray::_pos> *query_seed_hits,
-		DoubleArray<SeedArray::_pos> *ref_seed_hits,
+		DoubleArray<_pos> *query_seed_hits,
+		DoubleArray<_pos> *ref_seed_hits,
 		const SeedPartitionRange *range,
 		unsigned sid,
 		unsigned ref_max_n,
 		unsigned query_max_n,
 		vector<unsigned> *counts);
 
-	static void compute_sd(Atomic<unsigned> *seedp, DoubleArray<SeedArray::_pos> *query_seed_hits, DoubleArray<SeedArray::_pos> *ref_seed_hits, vector<Sd> *ref_out, vector<Sd> *query_out);
+	template<typename _pos>
+	static void compute_sd(Atomic<unsigned> *seedp, DoubleArray<_pos> *query_seed_hits, DoubleArray<_pos> *ref_seed_hits, vector<Sd> *ref_out, vector<Sd> *query_out);
 
 	PHash_set<void,murmur_hash> tables_[Const::max_shapes][Const::seedp];
 
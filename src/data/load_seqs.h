@@ -24,9 +24,26 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "../basic/translate.h"
 #include "../util/seq_file_format.h"
 
+inline bool translated_input()
+{
+	return !(config.command == Config::blastp || config.command == Config::makedb || config.command == Config::random_seqs);
+}
+
+// Pushes the six frames of a translated sequence. Frames that are not good or not
+// selected by frame_mask are masked.
+inline void push_frames(Sequence_set &ss, const sequence *frames, unsigned good_frames, unsigned frame_mask)
+{
+	for (unsigned j = 0; j < 6; ++j) {
+		if ((good_frames & (1 << j)) && (frame_mask & (1 << j)))
+			ss.push_back(frames[j].data(), frames[j].end());
+		else
+			ss.fill(frames[j].length(), value_traits.mask_char);
+	}
+}
+
 inline size_t push_seq(Sequence_set &ss, Sequence_set** source_seqs, const vector<Letter> &seq, unsigned frame_mask)
 {
-	if (config.command == Config::blastp || config.command == Config::makedb || config.command == Config::random_seqs) {
+	if (!translated_input()) {
 		ss.push_back(seq);
 		return seq.size();
 	}
@@ -37,20 +54,33 @@ inline size_t push_seq(Sequence_set &ss, Sequence_set** source_seqs, const vecto
 				ss.fill(0, value_traits.mask_char);
 			return 0;
 		}
-		vector<Letter> proteins[6];
-		size_t n = Translator::translate(seq, proteins);
-
-		unsigned bestFrames(Translator::computeGoodFrames(proteins, config.get_run_len((unsigned)seq.size() / 3)));
-		for (unsigned j = 0; j < 6; ++j) {
-			if ((bestFrames & (1 << j)) && (frame_mask & (1 << j)))
-				ss.push_back(proteins[j]);
-			else
-				ss.fill(proteins[j].size(), value_traits.mask_char);
-		}
+		vector<Letter> proteins[6], buf;
+		unsigned good_frames;
+		const size_t n = Translator::translate(sequence(seq), proteins, config.get_run_len((unsigned)seq.size() / 3), good_frames, buf);
+		sequence frames[6];
+		for (unsigned j = 0; j < 6; ++j)
+			frames[j] = sequence(proteins[j]);
+		push_frames(ss, frames, good_frames, frame_mask);
 		return n;
 	}
 }
 
+// Pushes a sequence from the buffers of the block parser, using the translations
+// of the block if the input is translated.
+inline size_t push_seq(Sequence_set &ss, Sequence_set** source_seqs, const sequence &seq, unsigned frame_mask, const FrameTranslations &translations, size_t i)
+{
+	if (!translated_input()) {
+		ss.push_back(seq.data(), seq.end());
+		return seq.length();
+	}
+	(*source_seqs)->push_back(seq.data(), seq.end());
+	sequence frames[6];
+	for (unsigned j = 0; j < 6; ++j)
+		frames[j] = translations.frame(i, j);
+	push_frames(ss, frames, seq.length() < 2 ? 0 : translations.good_frames(i), frame_mask);
+	return translations.letters(i);
+}
+
 inline size_t load_seqs(TextInputFile &file,
 	const Sequence_file_format &format,
 	Sequence_set** seqs,
@@ -58,8 +88,11 @@ inline size_t load_seqs(TextInputFile &file,
 	Sequence_set** source_seqs,
 	String_set<0>** quals,
 	size_t max_letters,
-	const string &filter)
+	const string &filter,
+	size_t threads = 0)
 {
+	if (threads == 0)
+		threads = config.threads_;
 	*seqs = new Sequence_set();
 	ids = new String_set<0>();
 	if(source_seqs)
@@ -77,15 +110,50 @@ inline size_t load_seqs(TextInputFile &file,
 	else if (config.query_strands == "minus")
 		frame_mask = ((1 << 3) - 1) << 3;
 
+	const auto check_size = [&]() {
+		++n;
+		if ((*seqs)->get_length() >(size_t)std::numeric_limits<int>::max())
+			throw std::runtime_error("Number of sequences in file exceeds supported maximum.");
+	};
+
+	// Records are parsed in blocks on several threads. A record that the block
+	// parser rejects, and all records after it, are read by get_seq.
+	if (threads > 1) {
+		SeqBlockParser parser(format, (unsigned)threads);
+		FrameTranslations translations;
+		vector<sequence> block_seqs;
+		while (letters < max_letters) {
+			const size_t records = parser.parse(file);
+			if (translated_input()) {
+				block_seqs.clear();
+				for (size_t i = 0; i < records && parser.valid(i); ++i)
+					block_seqs.push_back(parser.seq(i));
+				translations.translate(block_seqs, (unsigned)threads);
+			}
+			size_t i = 0;
+			for (; i < records && letters < max_letters && parser.valid(i); ++i) {
+				const sequence r = parser.seq(i), r_id = parser.id(i);
+				if (r.length() > 0 && (filter.empty() || id2.assign(r_id.data(), r_id.end()).find(filter, 0) != string::npos)) {
+					ids->push_back(r_id.data(), r_id.end());
+					letters += push_seq(**seqs, source_seqs, r, frame_mask, translations, i);
+					if (quals)
+						(*quals)->push_back(parser.qual(i).data(), parser.qual(i).end());
+					check_size();
+				}
+			}
+			parser.consume(file, i);
+			if (i < records || records == 0)
+				break;
+		}
+	}
+
 	while (letters < max_letters && format.get_seq(id, seq, file, quals ? &qual : nullptr)) {
 		if (seq.size() > 0 && (filter.empty() || id2.assign(id.data(), id.data() + id.size()).find(filter, 0) != string::npos)) {
 			ids->push_back(id);
 			letters += push_seq(**seqs, source_seqs, seq, frame_mask);
 			if (quals)
 				(*quals)->push_back(qual);
-			++n;
-			if ((*seqs)->get_length() >(size_t)std::numeric_limits<int>::max())
-				throw std::runtime_error("Number of sequences in file exceeds supported maximum.");
+			check_size();
 		}
 	}
 	ids->finish_reserve();
@@ -0,0 +1,158 @@
+/****
+DIAMOND protein aligner
+Copyright (C) 2013-2019 Benjamin Buchfink <buchfink@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+****/
+
+#ifndef MINIMIZER_H_
+#define MINIMIZER_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+#include "../basic/const.h"
+#include "../util/hash_function.h"
+
+// Seeds enumerated and kept by the minimizer sampling since the last reset.
+struct MinimizerStats
+{
+	static void reset()
+	{
+		seeds = 0;
+		sampled = 0;
+	}
+	static double density()
+	{
+		return seeds > 0 ? (double)sampled / seeds : 1.0;
+	}
+	static std::atomic<uint64_t> seeds, sampled;
+};
+
+// Expected fraction of the seeds kept for a minimizer window.
+inline double minimizer_density(unsigned window)
+{
+	return window > 1 ? 2.0 / (window + 1) : 1.0;
+}
+
+// Passes on the window minimizers of the seeds to the callback _f: of the seeds starting in
+// any window of the given number of consecutive positions, only the one with the smallest
+// hash value is kept, the leftmost one in case of ties. Every window that contains seeds thus
+// keeps at least one of them, while about 2/(window+1) of the seeds are kept overall. The
+// minimizers are chosen from all seeds and then passed through the filter. The seeds of each
+// shape must be enumerated in the order of their positions, and begin_sequence must be called
+// before those of a new sequence, so that windows do not span neighbouring sequences.
+template<typename _f, typename _filter>
+struct MinimizerCallback
+{
+
+	MinimizerCallback(_f &f, unsigned window, const _filter *filter) :
+		f_(f),
+		filter_(filter),
+		window_(window),
+		mask_(capacity(window) - 1),
+		seeds_(0),
+		sampled_(0)
+	{
+		for (unsigned i = 0; i < Const::max_shapes; ++i)
+			queues_[i].data.resize(mask_ + 1);
+	}
+
+	bool operator()(uint64_t seed, uint64_t pos, size_t shape)
+	{
+		Queue &q = queues_[shape];
+		const uint64_t h = murmur_hash()(seed);
+		++seeds_;
+		while (q.end > q.begin && q.data[(q.end - 1) & mask_].hash > h)
+			--q.end;
+		q.data[q.end++ & mask_] = Candidate{ h, seed, pos };
+		while (q.data[q.begin & mask_].pos + window_ <= pos)
+			++q.begin;
+		const Candidate &min = q.data[q.begin & mask_];
+		if (q.sampled && min.pos == q.last)
+			return true;
+		q.sampled = true;
+		q.last = min.pos;
+		++sampled_;
+		return filter_->contains(min.seed, shape) ? f_(min.seed, min.pos, shape) : true;
+	}
+
+	void begin_sequence(size_t shape)
+	{
+		Queue &q = queues_[shape];
+		q.begin = q.end;
+		q.sampled = false;
+	}
+
+	void finish()
+	{
+		MinimizerStats::seeds += seeds_;
+		MinimizerStats::sampled += sampled_;
+		f_.finish();
+	}
+
+private:
+
+	struct Candidate
+	{
+		uint64_t hash, seed, pos;
+	};
+
+	// Monotone queue of the candidates of the current window, in increasing order of position
+	// and hash value.
+	struct Queue
+	{
+		Queue() :
+			begin(0),
+			end(0),
+			last(0),
+			sampled(false)
+		{}
+		std::vector<Candidate> data;
+		size_t begin, end;
+		uint64_t last;
+		bool sampled;
+	};
+
+	// Before the oldest candidate is evicted, the queue holds up to window+1 of them.
+	static size_t capacity(unsigned window)
+	{
+		size_t n = 1;
+		while (n < window + 1)
+			n *= 2;
+		return n;
+	}
+
+	_f &f_;
+	const _filter *filter_;
+	const unsigned window_;
+	const size_t mask_;
+	uint64_t seeds_, sampled_;
+	Queue queues_[Const::max_shapes];
+
+};
+
+// Called by the seed enumeration before the seeds of a shape in the next sequence are passed
+// to the callback. Only the minimizer sampling depends on the sequence boundaries.
+template<typename _f>
+inline void begin_sequence(_f &, size_t)
+{}
+
+template<typename _f, typename _filter>
+inline void begin_sequence(MinimizerCallback<_f, _filter> &f, size_t shape)
+{
+	f.begin_sequence(shape);
+}
+
+#endif
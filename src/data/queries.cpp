@@ -16,9 +16,12 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ****/
 
+#include <string.h>
+#include <unordered_map>
 #include "queries.h"
 #include "../util/sequence/sequence.h"
 #include "../basic/config.h"
+#include "../util/hash_function.h"
 
 using namespace std;
 
@@ -31,8 +34,68 @@ vector<bool> query_aligned;
 std::mutex query_aligned_mtx;
 Seed_set *query_seeds = 0;
 Hashed_seed_set *query_seeds_hashed = 0;
+Bloom_seed_set *query_seeds_bloom = 0;
 String_set<0> *query_qual = nullptr;
 vector<unsigned> query_block_to_database_id;
+QueryDedup *query_dedup = nullptr;
+
+static uint64_t seq_hash(const sequence &seq)
+{
+	const Letter *p = seq.data();
+	const size_t len = seq.length();
+	uint64_t h = len;
+	size_t i = 0;
+	for (; i + 8 <= len; i += 8) {
+		uint64_t x;
+		memcpy(&x, p + i, 8);
+		h = murmur_hash()(h ^ x);
+	}
+	uint64_t x = 0;
+	memcpy(&x, p + i, len - i);
+	return murmur_hash()(h ^ x);
+}
+
+QueryDedup::QueryDedup(const Sequence_set &seqs, const Sequence_set *source_seqs):
+	count(0)
+{
+	const Sequence_set &s = align_mode.query_translated ? *source_seqs : seqs;
+	const size_t n = s.get_length();
+	representative.resize(n);
+	duplicates.insert(duplicates.end(), n, 0);
+	std::unordered_map<uint64_t, unsigned> first;
+	first.reserve(n);
+	for (size_t i = 0; i < n; ++i) {
+		const sequence seq = s[i];
+		auto it = first.emplace(seq_hash(seq), (unsigned)i).first;
+		const sequence r = s[it->second];
+		// A hash collision between different sequences leaves the query unique.
+		if (it->second != i && r.length() == seq.length() && memcmp(r.data(), seq.data(), seq.length()) == 0) {
+			representative[i] = it->second;
+			++duplicates[it->second];
+			++count;
+		}
+		else
+			representative[i] = (unsigned)i;
+	}
+}
+
+void QueryDedup::mask(Sequence_set &seqs) const
+{
+	const unsigned contexts = align_mode.query_contexts;
+	for (size_t i = 0; i < representative.size(); ++i)
+		if (duplicate(i))
+			for (size_t j = i * contexts; j < (i + 1) * contexts; ++j)
+				memset(seqs.ptr(j), value_traits.mask_char, seqs.length(j));
+}
+
+void QueryDedup::restore(Sequence_set &seqs) const
+{
+	const unsigned contexts = align_mode.query_contexts;
+	for (size_t i = 0; i < representative.size(); ++i)
+		if (duplicate(i))
+			for (unsigned j = 0; j < contexts; ++j)
+				memcpy(seqs.ptr(i * contexts + j), seqs.ptr(representative[i] * contexts + j), seqs.length(i * contexts + j));
+}
 
 void write_unaligned(OutputFile *file)
 {
@@ -70,8 +70,26 @@ inline TranslatedSequence get_translated_query(size_t query_id)
 		return TranslatedSequence(query_seqs::get()[query_id]);
 }
 
+// Assigns each query of the current chunk to the first query with an identical
+// sequence (or source sequence for translated searches). Only these representatives
+// are searched, while their duplicates receive a copy of the alignments.
+struct QueryDedup
+{
+	QueryDedup(const Sequence_set &seqs, const Sequence_set *source_seqs);
+	// Overwrites the duplicates with masked letters to exclude them from the seed search.
+	void mask(Sequence_set &seqs) const;
+	// Copies the sequences of the representatives back to their duplicates.
+	void restore(Sequence_set &seqs) const;
+	bool duplicate(size_t query) const
+	{ return representative[query] != query; }
+	vector<unsigned> representative, duplicates;
+	size_t count;
+};
+
+extern QueryDedup *query_dedup;
 extern Seed_set *query_seeds;
 extern Hashed_seed_set *query_seeds_hashed;
+extern Bloom_seed_set *query_seeds_bloom;
 extern vector<unsigned> query_block_to_database_id;
 
 #endif /* QUERIES_H_ */
@@ -73,7 +73,7 @@ uint32_t ReferenceDictionary::get(unsigned block, size_t block_id)
 		if (!config.no_dict) {
 			len_.push_back((uint32_t)ref_seqs::get().length(block_id));
 			database_id_.push_back((*block_to_database_id_)[block_id]);
-			const char *title = ref_ids::get()[block_id].c_str();
+			const char *title = ref_ids::title(block_id);
 			if (config.salltitles)
 				name_.push_back(new string(title));
 			else if (config.sallseqid)
@@ -99,7 +99,30 @@ void ReferenceDictionary::build_lazy_dict(DatabaseFile &db_file)
 	}
 	db_file.rewind();
 	vector<unsigned> block_to_database_id;
-	db_file.load_seqs(block_to_database_id, std::numeric_limits<size_t>::max(), &ref_seqs::data_, &ref_ids::data_, false, &filter);
+	Sequence_set *seqs;
+	String_set<0> *ids;
+	vector<Sequence_set*> parts;
+	// Blocks of multi-volume databases end at volume boundaries.
+	while (db_file.load_seqs(block_to_database_id, std::numeric_limits<size_t>::max(), &seqs, &ids, false, &filter))
+		parts.push_back(seqs);
+	if (parts.size() == 1)
+		ref_seqs::data_ = parts.front();
+	else {
+		ref_seqs::data_ = nullptr;
+		if (!parts.empty()) {
+			ref_seqs::data_ = new Sequence_set;
+			for (const Sequence_set *p : parts)
+				for (size_t i = 0; i < p->get_length(); ++i)
+					ref_seqs::data_->reserve(p->length(i));
+			ref_seqs::data_->finish_reserve();
+			size_t n = 0;
+			for (Sequence_set *p : parts) {
+				for (size_t i = 0; i < p->get_length(); ++i, ++n)
+					std::copy(p->ptr(i), p->ptr(i) + p->length(i) + 1, ref_seqs::data_->ptr(n));
+				delete p;
+			}
+		}
+	}
 	std::sort(m.begin(), m.end());
 	dict_to_lazy_dict_id_.clear();
 	dict_to_lazy_dict_id_.resize(dict_size);
@@ -21,6 +21,13 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <set>
 #include <map>
 #include <memory>
+#include <thread>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <iomanip>
+#include <exception>
+#include <string.h>
 #include "../basic/config.h"
 #include "reference.h"
 #include "load_seqs.h"
@@ -34,8 +41,17 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "taxonomy_nodes.h"
 #include "../util/algo/MurmurHash3.h"
 #include "../util/io/record_reader.h"
+#include "../basic/packed_sequence.h"
+#include "../util/string/string.h"
+#include "title_store.h"
 
 String_set<0>* ref_ids::data_ = 0;
+TitleStore* ref_ids::lazy_ = nullptr;
+
+const char* ref_ids::title(size_t block_id)
+{
+	return data_ ? (*data_)[block_id].c_str() : lazy_->get(block_id);
+}
 Partitioned_histogram ref_hst;
 unsigned current_ref_block;
 Sequence_set* ref_seqs::data_ = 0;
@@ -48,7 +64,7 @@ Serializer& operator<<(Serializer &s, const ReferenceHeader2 &h)
 	s.unset(Serializer::VARINT);
 	s << sizeof(ReferenceHeader2);
 	s.write(h.hash, sizeof(h.hash));
-	s << h.taxon_array_offset << h.taxon_array_size << h.taxon_nodes_offset << h.taxon_names_offset;
+	s << h.taxon_array_offset << h.taxon_array_size << h.taxon_nodes_offset << h.taxon_names_offset << h.title_index_offset << h.packed_seqs_offset << h.volume_table_offset << h.statistics_offset << h.mask_runs_offset;
 	return s;
 }
 
@@ -59,10 +75,96 @@ Deserializer& operator>>(Deserializer &d, ReferenceHeader2 &h)
 		>> h.taxon_array_size
 		>> h.taxon_nodes_offset
 		>> h.taxon_names_offset
+		>> h.title_index_offset
+		>> h.packed_seqs_offset
+		>> h.volume_table_offset
+		>> h.statistics_offset
+		>> h.mask_runs_offset
 		>> Finish();
 	return d;
 }
 
+DatabaseStatistics::DatabaseStatistics():
+	min_len(0),
+	max_len(0)
+{
+	std::fill(length_histogram, length_histogram + LENGTH_BINS, 0);
+	std::fill(composition, composition + AMINO_ACID_COUNT, 0);
+}
+
+void DatabaseStatistics::add(const sequence &seq)
+{
+	const size_t len = seq.length();
+	min_len = sequences() == 0 ? len : std::min(min_len, (uint64_t)len);
+	max_len = std::max(max_len, (uint64_t)len);
+	++length_histogram[len == 0 ? 0 : std::min((unsigned)std::log2((double)len), (unsigned)LENGTH_BINS - 1)];
+	for (size_t i = 0; i < len; ++i) {
+		const unsigned l = (unsigned)(seq[i] & 31);
+		if (l < AMINO_ACID_COUNT)
+			++composition[l];
+	}
+}
+
+DatabaseStatistics& DatabaseStatistics::operator+=(const DatabaseStatistics &s)
+{
+	if (s.sequences() == 0)
+		return *this;
+	min_len = sequences() == 0 ? s.min_len : std::min(min_len, s.min_len);
+	max_len = std::max(max_len, s.max_len);
+	for (unsigned i = 0; i < LENGTH_BINS; ++i)
+		length_histogram[i] += s.length_histogram[i];
+	for (unsigned i = 0; i < AMINO_ACID_COUNT; ++i)
+		composition[i] += s.composition[i];
+	return *this;
+}
+
+uint64_t DatabaseStatistics::sequences() const
+{
+	return std::accumulate(length_histogram, length_histogram + LENGTH_BINS, (uint64_t)0);
+}
+
+uint64_t DatabaseStatistics::letters() const
+{
+	return std::accumulate(composition, composition + AMINO_ACID_COUNT, (uint64_t)0);
+}
+
+size_t DatabaseStatistics::length_quantile(double q) const
+{
+	const uint64_t n = (uint64_t)std::ceil(sequences() * q);
+	uint64_t count = 0;
+	for (unsigned i = 0; i < LENGTH_BINS; ++i) {
+		count += length_histogram[i];
+		if (count >= n && count > 0)
+			return (size_t)std::min(((uint64_t)2 << i) - 1, max_len);
+	}
+	return (size_t)max_len;
+}
+
+Serializer& operator<<(Serializer &s, const DatabaseStatistics &stats)
+{
+	s << (unsigned long long)stats.min_len << (unsigned long long)stats.max_len << (unsigned)DatabaseStatistics::LENGTH_BINS;
+	s.write(stats.length_histogram, DatabaseStatistics::LENGTH_BINS);
+	s << (unsigned)AMINO_ACID_COUNT;
+	s.write(stats.composition, AMINO_ACID_COUNT);
+	return s;
+}
+
+Deserializer& operator>>(Deserializer &d, DatabaseStatistics &stats)
+{
+	unsigned long long min_len, max_len;
+	unsigned n;
+	d >> min_len >> max_len;
+	stats.min_len = min_len;
+	stats.max_len = max_len;
+	d >> n;
+	if (n != DatabaseStatistics::LENGTH_BINS || d.read(stats.length_histogram, n) != n)
+		throw std::runtime_error("Error reading database statistics.");
+	d >> n;
+	if (n != AMINO_ACID_COUNT || d.read(stats.composition, n) != n)
+		throw std::runtime_error("Error reading database statistics.");
+	return d;
+}
+
 
 struct Pos_record
 {
@@ -81,29 +183,103 @@ void DatabaseFile::init()
 	read_header(*this, ref_header);
 	if (ref_header.build < min_build_required || ref_header.db_version < MIN_DB_VERSION)
 		throw std::runtime_error("Database was built with an older version of Diamond and is incompatible.");
-	if (ref_header.db_version > ReferenceHeader::current_db_version)
+	if (ref_header.db_version > VOLUMES_DB_VERSION)
 		throw std::runtime_error("Database was built with a newer version of Diamond and is incompatible.");
 	if (ref_header.sequences == 0)
 		throw std::runtime_error("Incomplete database file. Database building did not complete successfully.");
 	*this >> header2;
 	pos_array_offset = ref_header.pos_array_offset;
+	read_seq_idx_ = 0;
+	search_volume_ = 0;
+	read_volume_ = 0;
+	mask_runs_ = 0;
+	mask_cursor_ = 0;
+	if (has_statistics()) {
+		seek(header2.statistics_offset);
+		*this >> statistics;
+	}
+	if (header2.mask_runs_offset != 0) {
+		seek(header2.mask_runs_offset);
+		read(&mask_runs_, 1);
+	}
+	if (ref_header.db_version == VOLUMES_DB_VERSION)
+		open_volumes();
+	else if (config.mmap_db)
+		map();
+}
+
+string DatabaseFile::volume_file_name(const string &database, size_t volume)
+{
+	string s = database;
+	if (ends_with(s, ".dmnd"))
+		s.erase(s.length() - 5);
+	return s + '.' + to_string(volume) + ".dmnd";
+}
+
+void DatabaseFile::open_volumes()
+{
+	seek(header2.volume_table_offset);
+	unsigned long long n;
+	*this >> n;
+	const size_t sep = file_name.find_last_of("/\\");
+	const string dir = sep == string::npos ? string() : file_name.substr(0, sep + 1);
+	for (unsigned long long i = 0; i < n; ++i) {
+		Volume v;
+		unsigned long long first_seq, sequences, letters;
+		*this >> v.file_name >> first_seq >> sequences >> letters;
+		v.first_seq = first_seq;
+		v.sequences = sequences;
+		v.letters = letters;
+		v.db.reset(new DatabaseFile(dir + v.file_name));
+		if (v.db->ref_header.sequences != v.sequences || v.db->ref_header.letters != v.letters)
+			throw std::runtime_error("Database volume does not match the manifest: " + dir + v.file_name);
+		search_volumes_.push_back(volumes_.size());
+		volumes_.push_back(v);
+	}
+}
+
+void DatabaseFile::select_volumes(const vector<string> &volumes)
+{
+	if (!has_volumes())
+		throw std::runtime_error("Volume selection requires a multi-volume database.");
+	search_volumes_.clear();
+	for (const string &s : volumes) {
+		const size_t i = atoi(s.c_str());
+		if (i >= volumes_.size())
+			throw std::runtime_error("Invalid database volume: " + s);
+		search_volumes_.push_back(i);
+	}
+	std::sort(search_volumes_.begin(), search_volumes_.end());
+	search_volumes_.erase(std::unique(search_volumes_.begin(), search_volumes_.end()), search_volumes_.end());
+	rewind();
+}
+
+void DatabaseFile::map()
+{
+	if (!separate_titles())
+		throw std::runtime_error("Memory mapping requires database format version " + to_string(SEPARATE_TITLES_DB_VERSION) + ". Please rebuild the database using the makedb command.");
+	mapped_.reset(new MappedFile(buffer_->root()->file(), file_name));
 }
 
 DatabaseFile::DatabaseFile(const string &input_file):
 	InputFile(input_file, InputFile::BUFFERED),
-	temporary(false)
+	temporary(false),
+	partial_block_(false)
 {
 	init();
 }
 
 DatabaseFile::DatabaseFile(TempFile &tmp_file):
 	InputFile(tmp_file, 0),
-	temporary(true)
+	temporary(true),
+	partial_block_(false)
 {
 	init();
 }
 
 void DatabaseFile::close() {
+	for (Volume &v : volumes_)
+		v.db->close();
 	if (temporary)
 		InputFile::close_and_delete();
 	else
@@ -136,20 +312,257 @@ bool DatabaseFile::has_taxon_scientific_names() {
 void DatabaseFile::rewind()
 {
 	pos_array_offset = ref_header.pos_array_offset;
+	search_volume_ = 0;
+	for (Volume &v : volumes_)
+		v.db->rewind();
+}
+
+// Writes the sequence section of packed databases.
+struct PackedSeqWriter
+{
+	PackedSeqWriter(OutputFile &out):
+		out_(out)
+	{}
+	void write(const Letter *seq, size_t len)
+	{
+		buf_.insert(buf_.end(), seq, seq + len);
+		if (buf_.size() >= BUFFER_LETTERS)
+			flush();
+	}
+	// Pads the last group with delimiters if final is set.
+	void flush(bool final = false)
+	{
+		if (final)
+			buf_.resize((buf_.size() + PACKED_GROUP_LETTERS - 1) / PACKED_GROUP_LETTERS * PACKED_GROUP_LETTERS, (Letter)sequence::DELIMITER);
+		const size_t groups = buf_.size() / PACKED_GROUP_LETTERS;
+		packed_.resize(groups * PACKED_GROUP_BYTES);
+		// The groups are packed on all threads, the calling thread taking the first part.
+		const ::partition<size_t> p(groups, config.threads_);
+		vector<thread> workers;
+		for (size_t i = 1; i < p.parts; ++i)
+			workers.emplace_back(pack_5bit, buf_.data() + p.getMin(i) * PACKED_GROUP_LETTERS, p.getCount(i), packed_.data() + p.getMin(i) * PACKED_GROUP_BYTES);
+		if (p.parts > 0)
+			pack_5bit(buf_.data(), p.getCount(0), packed_.data());
+		for (thread &t : workers)
+			t.join();
+		out_.write(packed_.data(), packed_.size());
+		buf_.erase(buf_.begin(), buf_.begin() + groups * PACKED_GROUP_LETTERS);
+	}
+private:
+	enum { BUFFER_LETTERS = 1 << 24 };
+	OutputFile &out_;
+	vector<Letter> buf_;
+	vector<uint8_t> packed_;
+};
+
+static const size_t MAKEDB_BATCH_LETTERS = 100000000;
+
+// Batch of input sequences that is parsed while the previous batch is written.
+struct MakedbBatch
+{
+	MakedbBatch():
+		seqs(nullptr),
+		ids(nullptr),
+		n(0)
+	{}
+	void free()
+	{
+		if (n > 0) {
+			delete seqs;
+			delete ids;
+		}
+		*this = MakedbBatch();
+	}
+	Sequence_set *seqs;
+	String_set<0> *ids;
+	size_t n;
+};
+
+static void load_batch(TextInputFile *file, MakedbBatch *batch, std::exception_ptr *error)
+{
+	static const FASTA_format format;
+	try {
+		batch->n = load_seqs(*file, format, &batch->seqs, batch->ids, 0, nullptr, MAKEDB_BATCH_LETTERS, string());
+	}
+	catch (...) {
+		*error = std::current_exception();
+	}
+}
+
+// The hash is chained over all sequences and has to be computed in database order.
+static void hash_batch(const MakedbBatch *batch, char *hash)
+{
+	for (size_t i = 0; i < batch->n; ++i) {
+		sequence seq = (*batch->seqs)[i], id = (*batch->ids)[i];
+		MurmurHash3_x64_128(seq.data(), (int)seq.length(), hash, hash);
+		MurmurHash3_x64_128(id.data(), (int)id.length(), hash, hash);
+	}
+}
+
+static void parse_accessions(const MakedbBatch *batch, size_t begin, size_t end, vector<vector<string>> *out)
+{
+	for (size_t i = begin; i < end; ++i)
+		(*out)[i] = Taxonomy::Accession::from_title((*batch->ids)[i].c_str());
 }
 
-void push_seq(const sequence &seq, const sequence &id, uint64_t &offset, vector<Pos_record> &pos_array, OutputFile &out, size_t &letters, size_t &n_seqs)
-{	
-	pos_array.emplace_back(offset, seq.length());
-	out.write("\xff", 1);
-	out.write(seq.data(), seq.length());
-	out.write("\xff", 1);
-	out.write(id.data(), id.length() + 1);
-	letters += seq.length();
-	++n_seqs;
-	offset += seq.length() + id.length() + 3;
+void write_padding(OutputFile &out, char c)
+{
+	const vector<char> padding(Sequence_set::PERIMETER_PADDING, c);
+	out.write(padding.data(), padding.size());
 }
 
+// Writes the sequence and title sections of a database file. Multi-volume
+// databases use one writer per volume file.
+struct VolumeWriter
+{
+	VolumeWriter(OutputFile *out, bool volume):
+		out(out),
+		volume(volume),
+		mask_run_count(0),
+		title_pos(1, 0),
+		letters(0),
+		sequences(0)
+	{
+		if (config.pack_seqs) {
+			header.db_version = DatabaseFile::PACKED_DB_VERSION;
+			packed.reset(new PackedSeqWriter(*out));
+			mask_runs.reset(new FileBackedBuffer);
+		}
+		out->write(&header, 1);
+		*out << header2;
+		if (packed)
+			header2.packed_seqs_offset = out->tell();
+		else
+			write_padding(*out, sequence::DELIMITER);
+		offset = packed ? 0 : out->tell();
+	}
+	~VolumeWriter()
+	{
+		if (volume)
+			delete out;
+	}
+	void push(const sequence &seq, const sequence &id)
+	{
+		pos_array.emplace_back(offset, seq.length());
+		const char delimiter = sequence::DELIMITER;
+		if (packed) {
+			packed->write(seq.data(), seq.length());
+			packed->write(&delimiter, 1);
+			push_mask_runs(seq);
+		}
+		else {
+			out->write(seq.data(), seq.length());
+			out->write(&delimiter, 1);
+		}
+		titles.write(id.data(), id.length() + 1);
+		title_pos.push_back(title_pos.back() + id.length() + 1);
+		// The hash of a single database file is computed by hash_batch.
+		if (volume) {
+			MurmurHash3_x64_128(seq.data(), (int)seq.length(), header2.hash, header2.hash);
+			MurmurHash3_x64_128(id.data(), (int)id.length(), header2.hash, header2.hash);
+		}
+		letters += seq.length();
+		++sequences;
+		offset += seq.length() + 1;
+	}
+	// The 5-bit code has no room for the soft mask, so the masked ranges are stored as runs.
+	void push_mask_runs(const sequence &seq)
+	{
+		for (size_t i = 0; i < seq.length(); ++i) {
+			if ((seq[i] & Masking::bit_mask) == 0)
+				continue;
+			MaskRun r;
+			r.begin = offset + i;
+			while (i < seq.length() && (seq[i] & Masking::bit_mask) != 0)
+				++i;
+			r.end = offset + i;
+			mask_runs->write(&r, 1);
+			++mask_run_count;
+		}
+	}
+	// Pushes the sequences [begin, end) of a batch. Their statistics are computed by
+	// the worker threads while the sequences are written.
+	void push(const MakedbBatch &batch, size_t begin, size_t end)
+	{
+		const ::partition<size_t> p(end - begin, config.threads_);
+		vector<DatabaseStatistics> part_statistics(p.parts);
+		vector<thread> workers;
+		for (size_t i = 0; i < p.parts; ++i)
+			workers.emplace_back([&batch, &part_statistics, &p, begin, i]() {
+				for (size_t j = begin + p.getMin(i); j < begin + p.getMax(i); ++j)
+					part_statistics[i].add((*batch.seqs)[j]);
+			});
+		try {
+			for (size_t j = begin; j < end; ++j)
+				push((*batch.seqs)[j], (*batch.ids)[j]);
+		}
+		catch (std::exception&) {
+			for (thread &t : workers)
+				t.join();
+			throw;
+		}
+		for (thread &t : workers)
+			t.join();
+		for (const DatabaseStatistics &s : part_statistics)
+			statistics += s;
+	}
+	// Writes the titles and the trailer. Volume files are completed and closed,
+	// a single database file is continued by the caller.
+	void finish()
+	{
+		if (packed)
+			packed->flush(true);
+		else
+			write_padding(*out, sequence::DELIMITER);
+		write_padding(*out, '\0');
+		const uint64_t title_offset = out->tell();
+		titles.rewind();
+		vector<char> buf(1 << 20);
+		size_t count;
+		while ((count = titles.read(buf.data(), buf.size())) > 0)
+			out->write(buf.data(), count);
+		write_padding(*out, '\0');
+
+		header.pos_array_offset = out->tell();
+		pos_array.emplace_back(offset, 0);
+		out->write_raw(pos_array);
+		header2.title_index_offset = out->tell();
+		for (uint64_t &i : title_pos)
+			i += title_offset;
+		out->write_raw(title_pos);
+		header2.statistics_offset = out->tell();
+		*out << statistics;
+		if (packed) {
+			header2.mask_runs_offset = out->tell();
+			out->write(&mask_run_count, 1);
+			mask_runs->rewind();
+			while ((count = mask_runs->read(buf.data(), buf.size())) > 0)
+				out->write(buf.data(), count);
+		}
+		header.letters = letters;
+		header.sequences = sequences;
+		if (volume) {
+			out->seek(0);
+			out->write(&header, 1);
+			*out << header2;
+			out->close();
+		}
+	}
+	OutputFile *out;
+	const bool volume;
+	ReferenceHeader header;
+	ReferenceHeader2 header2;
+	DatabaseStatistics statistics;
+	unique_ptr<PackedSeqWriter> packed;
+	unique_ptr<FileBackedBuffer> mask_runs;
+	uint64_t mask_run_count;
+	vector<Pos_record> pos_array;
+	vector<uint64_t> title_pos;
+	FileBackedBuffer titles;
+	uint64_t offset;
+	size_t letters, sequences;
+};
+
 void make_db(TempFile **tmp_out)
 {
 	message_stream << "Database file: " << config.input_ref_file << endl;
@@ -162,50 +575,117 @@ void make_db(TempFile **tmp_out)
 	unique_ptr<TextInputFile> db_file (new TextInputFile(config.input_ref_file));
 	
 	OutputFile *out = tmp_out ? new TempFile() : new OutputFile(config.database);
-	ReferenceHeader header;
-	ReferenceHeader2 header2;
-
-	out->write(&header, 1);
-	*out << header2;
+	const bool multi_volume = config.volume_size > 0.0 && !tmp_out;
+	const size_t volume_letters = (size_t)(config.volume_size * 1e9);
+	ReferenceHeader manifest_header;
+	ReferenceHeader2 manifest_header2;
+	DatabaseStatistics manifest_statistics;
+	vector<DatabaseFile::Volume> volume_table;
+	unique_ptr<VolumeWriter> volume;
+	if (multi_volume) {
+		manifest_header.db_version = DatabaseFile::VOLUMES_DB_VERSION;
+		out->write(&manifest_header, 1);
+		*out << manifest_header2;
+	}
+	else
+		volume.reset(new VolumeWriter(out, false));
+	ReferenceHeader &header = multi_volume ? manifest_header : volume->header;
+	ReferenceHeader2 &header2 = multi_volume ? manifest_header2 : volume->header2;
 
-	size_t letters = 0, n = 0, n_seqs = 0;
-	uint64_t offset = out->tell();
+	const auto finish_volume = [&]() {
+		volume->finish();
+		volume_table.back().sequences = volume->sequences;
+		volume_table.back().letters = volume->letters;
+		manifest_statistics += volume->statistics;
+	};
 
-	Sequence_set *seqs;
-	String_set<0> *ids;
-	const FASTA_format format;
-	vector<Pos_record> pos_array;
+	size_t letters = 0, n_seqs = 0;
 	FileBackedBuffer accessions;
+	MakedbBatch batch, next;
+	std::exception_ptr load_error;
 
 	try {
-		while ((timer.go("Loading sequences"), n = load_seqs(*db_file, format, &seqs, ids, 0, nullptr, (size_t)(1e9), string())) > 0) {
-			if (config.masking == 1) {
-				timer.go("Masking sequences");
-				mask_seqs(*seqs, Masking::get(), false);
-			}
-			timer.go("Writing sequences");
-			for (size_t i = 0; i < n; ++i) {
-				sequence seq = (*seqs)[i];
-				if (seq.length() == 0)
-					throw std::runtime_error("File format error: sequence of length 0 at line " + to_string(db_file->line_count));
-				push_seq(seq, (*ids)[i], offset, pos_array, *out, letters, n_seqs);
+		timer.go("Loading sequences");
+		load_batch(db_file.get(), &batch, &load_error);
+		if (load_error)
+			std::rethrow_exception(load_error);
+		while (batch.n > 0) {
+			std::thread loader(load_batch, db_file.get(), &next, &load_error);
+			try {
+				if (config.masking == 1) {
+					timer.go("Masking sequences");
+					mask_seqs(*batch.seqs, Masking::get(), false);
+				}
+				timer.go("Writing sequences");
+				vector<vector<string>> batch_accessions;
+				vector<thread> workers;
+				workers.emplace_back(hash_batch, &batch, header2.hash);
+				if (!config.prot_accession2taxid.empty()) {
+					batch_accessions.resize(batch.n);
+					const ::partition<size_t> p(batch.n, config.threads_);
+					for (size_t i = 0; i < p.parts; ++i)
+						workers.emplace_back(parse_accessions, &batch, p.getMin(i), p.getMax(i), &batch_accessions);
+				}
+				try {
+					for (size_t begin = 0, end; begin < batch.n; begin = end) {
+						if (multi_volume && (!volume || volume->letters >= volume_letters)) {
+							if (volume)
+								finish_volume();
+							const string file_name = DatabaseFile::volume_file_name(config.database, volume_table.size());
+							volume_table.push_back(DatabaseFile::Volume());
+							volume_table.back().file_name = file_name;
+							volume_table.back().first_seq = n_seqs;
+							volume.reset(new VolumeWriter(new OutputFile(file_name), true));
+						}
+						// The sequences up to the next volume boundary are pushed together.
+						const size_t volume_begin = volume->letters;
+						size_t volume_end = volume_begin;
+						end = begin;
+						do
+							volume_end += batch.seqs->length(end++);
+						while (end < batch.n && (!multi_volume || volume_end < volume_letters));
+						volume->push(batch, begin, end);
+						letters += volume->letters - volume_begin;
+						n_seqs += end - begin;
+					}
+				}
+				catch (std::exception&) {
+					for (thread &t : workers)
+						t.join();
+					throw;
+				}
+				timer.go("Hashing sequences");
+				for (thread &t : workers)
+					t.join();
+				if (!config.prot_accession2taxid.empty()) {
+					timer.go("Writing accessions");
+					for (const vector<string> &a : batch_accessions)
+						accessions << a;
+				}
 			}
-			if (!config.prot_accession2taxid.empty()) {
-				timer.go("Writing accessions");
-				for (size_t i = 0; i < n; ++i)
-					accessions << Taxonomy::Accession::from_title((*ids)[i].c_str());
+			catch (std::exception&) {
+				loader.join();
+				next.free();
+				throw;
 			}
-			timer.go("Hashing sequences");
-			for (size_t i = 0; i < n; ++i) {
-				sequence seq = (*seqs)[i], id = (*ids)[i];
-				MurmurHash3_x64_128(seq.data(), (int)seq.length(), header2.hash, header2.hash);
-				MurmurHash3_x64_128(id.data(), (int)id.length(), header2.hash, header2.hash);
-			}
-			delete seqs;
-			delete ids;
+			batch.free();
+			timer.go("Loading sequences");
+			loader.join();
+			if (load_error)
+				std::rethrow_exception(load_error);
+			batch = next;
+			next = MakedbBatch();
 		}
 	}
 	catch (std::exception&) {
+		batch.free();
+		if (multi_volume && volume) {
+			volume->out->close();
+			volume.reset();
+		}
+		for (const DatabaseFile::Volume &v : volume_table)
+			if (::remove(v.file_name.c_str()) != 0)
+				std::cerr << "Warning: Failed to delete file " << v.file_name << endl;
 		out->close();
 		out->remove();
 		throw;
@@ -213,10 +693,26 @@ void make_db(TempFile **tmp_out)
 
 	timer.finish();
 	
+	timer.go("Writing titles");
+	if (volume) {
+		if (multi_volume)
+			finish_volume();
+		else
+			volume->finish();
+	}
+	
 	timer.go("Writing trailer");
-	header.pos_array_offset = offset;
-	pos_array.emplace_back(offset, 0);
-	out->write_raw(pos_array);
+	if (multi_volume) {
+		header2.volume_table_offset = out->tell();
+		*out << (unsigned long long)volume_table.size();
+		for (const DatabaseFile::Volume &v : volume_table) {
+			const size_t sep = v.file_name.find_last_of("/\\");
+			*out << (sep == string::npos ? v.file_name : v.file_name.substr(sep + 1))
+				<< (unsigned long long)v.first_seq << (unsigned long long)v.sequences << (unsigned long long)v.letters;
+		}
+		header2.statistics_offset = out->tell();
+		*out << manifest_statistics;
+	}
 	timer.finish();
 
 	taxonomy.init();
@@ -252,27 +748,143 @@ void make_db(TempFile **tmp_out)
 
 	timer.finish();
 	message_stream << "Database hash = " << hex_print(header2.hash, 16) << endl;
+	if (multi_volume)
+		message_stream << "Database volumes = " << volume_table.size() << endl;
 	message_stream << "Processed " << n_seqs << " sequences, " << letters << " letters." << endl;
 	message_stream << "Total time = " << total.getElapsedTimeInSec() << "s" << endl;
 }
 
 void DatabaseFile::seek_seq(size_t i) {
+	if (has_volumes()) {
+		search_volume_ = 0;
+		while (search_volume_ + 1 < search_volumes_.size() && i >= volumes_[search_volumes_[search_volume_ + 1]].first_seq)
+			++search_volume_;
+		for (size_t j = search_volume_ + 1; j < search_volumes_.size(); ++j)
+			volumes_[search_volumes_[j]].db->rewind();
+		const Volume &v = volumes_[search_volumes_[search_volume_]];
+		v.db->seek_seq(std::min(std::max(i, (size_t)v.first_seq) - v.first_seq, (size_t)v.sequences));
+		return;
+	}
 	pos_array_offset = ref_header.pos_array_offset + sizeof(Pos_record)*i;
 }
 
 size_t DatabaseFile::tell_seq() const {
+	if (has_volumes()) {
+		if (search_volume_ >= search_volumes_.size())
+			return ref_header.sequences;
+		const Volume &v = volumes_[search_volumes_[search_volume_]];
+		return v.first_seq + v.db->tell_seq();
+	}
 	return (pos_array_offset - ref_header.pos_array_offset) / sizeof(Pos_record);
 }
 
 void DatabaseFile::seek_direct() {
-	seek(sizeof(ReferenceHeader) + sizeof(ReferenceHeader2) + 8);
+	read_seq_idx_ = 0;
+	read_volume_ = 0;
+	if (has_volumes()) {
+		volumes_.front().db->seek_direct();
+		return;
+	}
+	Pos_record r;
+	seek(ref_header.pos_array_offset);
+	read(&r, 1);
+	seek(r.pos);
+}
+
+void DatabaseFile::read_packed(uint64_t begin, uint64_t end, Letter *dst, bool soft_mask)
+{
+	static const uint64_t CHUNK_GROUPS = 1 << 14;
+	vector<uint8_t> buf;
+	vector<Letter> letters;
+	uint64_t group = begin / PACKED_GROUP_LETTERS;
+	const uint64_t end_group = (end + PACKED_GROUP_LETTERS - 1) / PACKED_GROUP_LETTERS;
+	while (group < end_group) {
+		const uint64_t n = std::min(CHUNK_GROUPS, end_group - group);
+		const uint64_t file_offset = header2.packed_seqs_offset + group * PACKED_GROUP_BYTES;
+		const uint8_t *src;
+		if (mapped_)
+			src = (const uint8_t*)mapped_->data(file_offset);
+		else {
+			buf.resize(n * PACKED_GROUP_BYTES);
+			seek(file_offset);
+			read(buf.data(), buf.size());
+			src = buf.data();
+		}
+		letters.resize(n * PACKED_GROUP_LETTERS);
+		unpack_5bit(src, n, letters.data());
+		const uint64_t first = group * PACKED_GROUP_LETTERS, b = std::max(begin, first), e = std::min(end, first + letters.size());
+		std::copy(letters.begin() + (b - first), letters.begin() + (e - first), dst + (b - begin));
+		group += n;
+	}
+	if (soft_mask && mask_runs_ > 0)
+		read_mask(begin, end, dst);
 }
 
-bool DatabaseFile::load_seqs(vector<unsigned> &block_to_database_id, size_t max_letters, Sequence_set **dst_seq, String_set<0> **dst_id, bool load_ids, const vector<bool> *filter)
+MaskRun DatabaseFile::mask_run(size_t i)
 {
-	task_timer timer("Loading reference sequences");
+	MaskRun r;
+	const uint64_t offset = header2.mask_runs_offset + sizeof(uint64_t) + i * sizeof(MaskRun);
+	if (mapped_)
+		memcpy(&r, mapped_->data(offset), sizeof(MaskRun));
+	else {
+		seek(offset);
+		read(&r, 1);
+	}
+	return r;
+}
+
+// Sets the mask bit of the letters [begin, end) that lie in mask runs. The runs are sorted, so
+// that reading the sequences in order only looks at the runs following the previous range.
+void DatabaseFile::read_mask(uint64_t begin, uint64_t end, Letter *dst)
+{
+	size_t i = mask_cursor_ > 0 && mask_run(mask_cursor_ - 1).end <= begin ? mask_cursor_ : 0;
+	if (i < mask_runs_ && mask_run(i).end <= begin) {
+		size_t n = mask_runs_ - i - 1;
+		++i;
+		while (n > 0) {
+			const size_t half = n / 2;
+			if (mask_run(i + half).end <= begin) {
+				i += half + 1;
+				n -= half + 1;
+			}
+			else
+				n = half;
+		}
+	}
+	for (; i < mask_runs_; ++i) {
+		const MaskRun r = mask_run(i);
+		if (r.begin >= end)
+			break;
+		for (uint64_t j = std::max(r.begin, begin); j < std::min(r.end, end); ++j)
+			dst[j - begin] |= Masking::bit_mask;
+		if (r.end > end)
+			break;
+	}
+	mask_cursor_ = i;
+}
+
+// Makes the section [begin, end) of the mapped file the data of a block. The perimeter padding
+// of the view is the padding written at the start and end of the section in the file for the
+// first and the last block, and the neighbouring sequences for the other blocks. Since every
+// sequence is delimited on both sides, these are never read as part of the block.
+template<char _pchar, size_t _padding>
+static void map_block(MappedFile &file, size_t begin, size_t end, String_set<_pchar, _padding> &dst)
+{
+	const size_t padding = String_set<_pchar, _padding>::PERIMETER_PADDING;
+	if (begin < padding || end + padding > file.size())
+		throw std::runtime_error("Mapped database block is missing perimeter padding.");
+	dst.attach(file.data(begin - padding));
+}
+
+bool DatabaseFile::load_seqs(vector<unsigned> &block_to_database_id, size_t max_letters, Sequence_set **dst_seq, String_set<0> **dst_id, bool load_ids, const vector<bool> *filter, unsigned timer_level)
+{
+	if (has_volumes())
+		return load_volume_seqs(block_to_database_id, max_letters, dst_seq, dst_id, load_ids, filter, timer_level);
+	task_timer timer("Loading reference sequences", timer_level);
 	seek(pos_array_offset);
 	size_t database_id = tell_seq();
+	const size_t first_id = database_id;
+	const bool v4 = separate_titles();
 	size_t letters = 0, seqs = 0, id_letters = 0, seqs_processed = 0;
 	vector<uint64_t> filtered_pos;
 	block_to_database_id.clear();
@@ -291,12 +903,15 @@ bool DatabaseFile::load_seqs(vector<unsigned> &block_to_database_id, size_t max_
 		if (!filter || (*filter)[database_id]) {
 			letters += r.seq_len;
 			(*dst_seq)->reserve(r.seq_len);
-			const size_t id_len = r_next.pos - r.pos - r.seq_len - 3;
-			id_letters += id_len;
-			if (load_ids) (*dst_id)->reserve(id_len);
+			if (!v4) {
+				const size_t id_len = r_next.pos - r.pos - r.seq_len - 3;
+				id_letters += id_len;
+				if (load_ids) (*dst_id)->reserve(id_len);
+			}
 			++seqs;
 			block_to_database_id.push_back((unsigned)database_id);
-			if (filter) filtered_pos.push_back(last ? 0 : r.pos);
+			if (v4 && filter) filtered_pos.push_back(r.pos);
+			else if (filter) filtered_pos.push_back(last ? 0 : r.pos);
 			last = true;
 		}
 		else
@@ -315,32 +930,140 @@ bool DatabaseFile::load_seqs(vector<unsigned> &block_to_database_id, size_t max_
 		return false;
 	}
 
-	(*dst_seq)->finish_reserve();
-	if(load_ids) (*dst_id)->finish_reserve();
-	seek(start_offset);
+	if (v4) {
+		vector<uint64_t> title_pos;
+		if (load_ids) {
+			title_pos.resize(seqs_processed + 1);
+			seek(header2.title_index_offset + sizeof(uint64_t) * first_id);
+			read(title_pos.data(), title_pos.size());
+			for (unsigned i : block_to_database_id)
+				(*dst_id)->reserve(title_pos[i - first_id + 1] - title_pos[i - first_id] - 1);
+		}
+		if (packed()) {
+			(*dst_seq)->finish_reserve();
+			if (load_ids) (*dst_id)->finish_reserve();
+			if (filter)
+				for (size_t n = 0; n < seqs; ++n)
+					read_packed(filtered_pos[n], filtered_pos[n] + (*dst_seq)->length(n) + 1, (*dst_seq)->ptr(n));
+			else
+				read_packed(start_offset, r.pos, (*dst_seq)->ptr(0));
+			if (load_ids) {
+				if (filter)
+					for (size_t n = 0; n < seqs; ++n) {
+						seek(title_pos[block_to_database_id[n] - first_id]);
+						read((*dst_id)->ptr(n), (*dst_id)->length(n) + 1);
+					}
+				else {
+					seek(title_pos.front());
+					read((*dst_id)->ptr(0), title_pos.back() - title_pos.front());
+				}
+			}
+		}
+		else if (mapped_ && !filter) {
+			mapped_->prefetch(start_offset, r.pos - start_offset);
+			map_block(*mapped_, start_offset, r.pos, **dst_seq);
+			if (load_ids)
+				map_block(*mapped_, title_pos.front(), title_pos.back(), **dst_id);
+		}
+		else {
+			(*dst_seq)->finish_reserve();
+			if (load_ids) (*dst_id)->finish_reserve();
+			if (filter) {
+				for (size_t n = 0; n < seqs; ++n) {
+					seek(filtered_pos[n]);
+					read((*dst_seq)->ptr(n), (*dst_seq)->length(n) + 1);
+					if (load_ids) {
+						seek(title_pos[block_to_database_id[n] - first_id]);
+						read((*dst_id)->ptr(n), (*dst_id)->length(n) + 1);
+					}
+				}
+			}
+			else {
+				seek(start_offset);
+				read((*dst_seq)->ptr(0), r.pos - start_offset);
+				if (load_ids) {
+					seek(title_pos.front());
+					read((*dst_id)->ptr(0), title_pos.back() - title_pos.front());
+				}
+			}
+		}
+	}
+	else {
+		(*dst_seq)->finish_reserve();
+		if (load_ids) (*dst_id)->finish_reserve();
+		seek(start_offset);
+	}
 
 	for (size_t n = 0; n < seqs; ++n) {
-		if (filter && filtered_pos[n]) seek(filtered_pos[n]);
-		read((*dst_seq)->ptr(n) - 1, (*dst_seq)->length(n) + 2);
-		*((*dst_seq)->ptr(n) - 1) = sequence::DELIMITER;
-		*((*dst_seq)->ptr(n) + (*dst_seq)->length(n)) = sequence::DELIMITER;
-		if (load_ids)
-			read((*dst_id)->ptr(n), (*dst_id)->length(n) + 1);
-		else
-			if (!seek_forward('\0')) throw std::runtime_error("Unexpected end of file.");
+		if (!v4) {
+			if (filter && filtered_pos[n]) seek(filtered_pos[n]);
+			read((*dst_seq)->ptr(n) - 1, (*dst_seq)->length(n) + 2);
+			*((*dst_seq)->ptr(n) - 1) = sequence::DELIMITER;
+			*((*dst_seq)->ptr(n) + (*dst_seq)->length(n)) = sequence::DELIMITER;
+			if (load_ids)
+				read((*dst_id)->ptr(n), (*dst_id)->length(n) + 1);
+			else
+				if (!seek_forward('\0')) throw std::runtime_error("Unexpected end of file.");
+		}
 		Masking::get().remove_bit_mask((*dst_seq)->ptr(n), (*dst_seq)->length(n));
 		if (!config.sfilt.empty() && strstr((**dst_id)[n].c_str(), config.sfilt.c_str()) == 0)
 			memset((*dst_seq)->ptr(n), value_traits.mask_char, (*dst_seq)->length(n));
 	}
 	timer.finish();
-	(*dst_seq)->print_stats();
 
-	blocked_processing = seqs_processed < ref_header.sequences;
+	partial_block_ = seqs_processed < ref_header.sequences;
 	return true;
 }
 
+// Reference blocks do not span volumes. The block ids are mapped to the global
+// sequence numbers of the database.
+bool DatabaseFile::load_volume_seqs(vector<unsigned> &block_to_database_id, size_t max_letters, Sequence_set **dst_seq, String_set<0> **dst_id, bool load_ids, const vector<bool> *filter, unsigned timer_level)
+{
+	for (; search_volume_ < search_volumes_.size(); ++search_volume_) {
+		const Volume &v = volumes_[search_volumes_[search_volume_]];
+		vector<bool> volume_filter;
+		if (filter)
+			volume_filter.assign(filter->begin() + v.first_seq, filter->begin() + v.first_seq + v.sequences);
+		if (v.db->load_seqs(block_to_database_id, max_letters, dst_seq, dst_id, load_ids, filter ? &volume_filter : nullptr, timer_level)) {
+			for (unsigned &i : block_to_database_id)
+				i += (unsigned)v.first_seq;
+			partial_block_ = v.db->partial_block() || search_volumes_.size() > 1;
+			return true;
+		}
+	}
+	return false;
+}
+
 void DatabaseFile::read_seq(string &id, vector<char> &seq)
 {
+	if (has_volumes()) {
+		while (read_seq_idx_ >= volumes_[read_volume_].first_seq + volumes_[read_volume_].sequences)
+			volumes_[++read_volume_].db->seek_direct();
+		volumes_[read_volume_].db->read_seq(id, seq);
+		++read_seq_idx_;
+		return;
+	}
+	if (separate_titles()) {
+		Pos_record r;
+		uint64_t title_pos;
+		seek(ref_header.pos_array_offset + sizeof(Pos_record) * read_seq_idx_);
+		read(&r, 1);
+		seek(header2.title_index_offset + sizeof(uint64_t) * read_seq_idx_);
+		read(&title_pos, 1);
+		if (packed()) {
+			const size_t n = seq.size();
+			seq.resize(n + r.seq_len);
+			read_packed(r.pos, r.pos + r.seq_len, seq.data() + n, true);
+		}
+		else {
+			seek(r.pos);
+			read_until(seq, sequence::DELIMITER);
+		}
+		seek(title_pos);
+		read_until(id, '\0');
+		++read_seq_idx_;
+		return;
+	}
 	char c;
 	read(&c, 1);
 	read_until(seq, '\xff');
@@ -372,6 +1095,7 @@ void DatabaseFile::get_seq()
 	size_t letters = 0;
 	TextBuffer buf;
 	OutputFile out(config.output_file);
+	seek_direct();
 	for (size_t n = 0; n < ref_header.sequences; ++n) {
 		read_seq(id, seq);
 		std::map<string, string>::const_iterator mapped_title = seq_titles.find(blast_id(id));
@@ -409,6 +1133,30 @@ void db_info()
 	cout << "Diamond build = " << header.build << endl;
 	cout << "Sequences = " << header.sequences << endl;
 	cout << "Letters = " << header.letters << endl;
+	ReferenceHeader2 header2;
+	db_file >> header2;
+	if (header.db_version == DatabaseFile::PACKED_DB_VERSION)
+		cout << "Sequence encoding = 5-bit packed" << endl;
+	if (header.db_version == DatabaseFile::VOLUMES_DB_VERSION) {
+		unsigned long long n;
+		db_file.seek(header2.volume_table_offset);
+		db_file >> n;
+		cout << "Volumes = " << n << endl;
+	}
+	if (header2.statistics_offset != 0) {
+		DatabaseStatistics stats;
+		db_file.seek(header2.statistics_offset);
+		db_file >> stats;
+		cout << "Sequence length = " << stats.min_len << '-' << stats.max_len << " (median <= " << stats.length_quantile(0.5) << ")" << endl;
+		cout << "Length histogram:";
+		for (unsigned i = 0; i <= std::min((unsigned)std::log2((double)std::max(stats.max_len, (uint64_t)1)), (unsigned)DatabaseStatistics::LENGTH_BINS - 1); ++i)
+			cout << ' ' << (1llu << i) << ':' << stats.length_histogram[i];
+		cout << endl << "Composition:";
+		for (unsigned i = 0; i < AMINO_ACID_COUNT; ++i)
+			if (stats.composition[i] > 0)
+				cout << ' ' << amino_acid_traits.alphabet[i] << ':' << std::setprecision(3) << (double)stats.composition[i] / stats.letters() * 100 << '%';
+		cout << endl;
+	}
 	db_file.close();
 }
 
@@ -23,8 +23,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <string>
 #include <string.h>
 #include <stdint.h>
+#include <memory>
 #include "../util/io/serializer.h"
 #include "../util/io/input_file.h"
+#include "../util/io/mapped_file.h"
 #include "../data/seed_histogram.h"
 #include "sequence_set.h"
 #include "metadata.h"
@@ -44,7 +46,7 @@ struct ReferenceHeader
 	uint64_t magic_number;
 	uint32_t build, db_version;
 	uint64_t sequences, letters, pos_array_offset;
-	enum { current_db_version = 3 };
+	enum { current_db_version = 4 };
 	static constexpr uint64_t MAGIC_NUMBER = 0x24af8a415ee186dllu;
 };
 
@@ -54,17 +56,47 @@ struct ReferenceHeader2
 		taxon_array_offset(0),
 		taxon_array_size(0),
 		taxon_nodes_offset(0),
-		taxon_names_offset(0)
+		taxon_names_offset(0),
+		title_index_offset(0),
+		packed_seqs_offset(0),
+		volume_table_offset(0),
+		statistics_offset(0),
+		mask_runs_offset(0)
 	{
 		memset(hash, 0, sizeof(hash));
 	}
 	char hash[16];
-	uint64_t taxon_array_offset, taxon_array_size, taxon_nodes_offset, taxon_names_offset;
+	uint64_t taxon_array_offset, taxon_array_size, taxon_nodes_offset, taxon_names_offset, title_index_offset, packed_seqs_offset, volume_table_offset, statistics_offset, mask_runs_offset;
 
 	friend Serializer& operator<<(Serializer &s, const ReferenceHeader2 &h);
 	friend Deserializer& operator>>(Deserializer &d, ReferenceHeader2 &h);
 };
 
+// Length histogram and residue composition of the database sequences, which
+// makedb stores in a section of the database file.
+struct DatabaseStatistics
+{
+	// Bin i counts the sequences of length [2^i, 2^(i+1)).
+	enum { LENGTH_BINS = 32 };
+	DatabaseStatistics();
+	void add(const sequence &seq);
+	DatabaseStatistics& operator+=(const DatabaseStatistics &s);
+	uint64_t sequences() const;
+	uint64_t letters() const;
+	// Upper bound of the length of the given fraction of the shortest sequences.
+	size_t length_quantile(double q) const;
+	uint64_t min_len, max_len, length_histogram[LENGTH_BINS], composition[AMINO_ACID_COUNT];
+
+	friend Serializer& operator<<(Serializer &s, const DatabaseStatistics &stats);
+	friend Deserializer& operator>>(Deserializer &d, DatabaseStatistics &stats);
+};
+
+// Range [begin, end) of soft-masked letters in the packed sequence stream.
+struct MaskRun
+{
+	uint64_t begin, end;
+};
+
 struct Database_format_exception : public std::exception
 {
 	virtual const char* what() const throw()
@@ -80,7 +112,7 @@ struct DatabaseFile : public InputFile
 	static DatabaseFile* auto_create_from_fasta();
 	static bool is_diamond_db(const string &file_name);
 	void rewind();
-	bool load_seqs(vector<unsigned> &block_to_database_id, size_t max_letters, Sequence_set **dst_seq, String_set<0> **dst_id, bool load_ids = true, const vector<bool> *filter = NULL);
+	bool load_seqs(vector<unsigned> &block_to_database_id, size_t max_letters, Sequence_set **dst_seq, String_set<0> **dst_id, bool load_ids = true, const vector<bool> *filter = NULL, unsigned timer_level = 1);
 	void get_seq();
 	void read_seq(string &id, vector<char> &seq);
 	bool has_taxon_id_lists();
@@ -90,16 +122,84 @@ struct DatabaseFile : public InputFile
 	void seek_seq(size_t i);
 	size_t tell_seq() const;
 	void seek_direct();
+	// Decodes the letters [begin, end) of the packed sequence section. The soft mask is
+	// restored from the mask runs if soft_mask is set.
+	void read_packed(uint64_t begin, uint64_t end, Letter *dst, bool soft_mask = false);
+
+	// Format version 4 stores sequences and titles in separate contiguous sections
+	// that have the same layout as the in-memory Sequence_set/String_set.
+	bool separate_titles() const
+	{
+		return ref_header.db_version >= SEPARATE_TITLES_DB_VERSION;
+	}
+
+	// Format version 5 stores the sequence section 5-bit packed. Sequence
+	// positions then refer to letters of the packed stream instead of file offsets.
+	bool packed() const
+	{
+		return ref_header.db_version == PACKED_DB_VERSION;
+	}
 
-	enum { min_build_required = 74, MIN_DB_VERSION = 2 };
+	bool has_statistics() const
+	{
+		return header2.statistics_offset != 0;
+	}
+
+	// Whether the last block loaded does not hold all sequences of the database, so
+	// that the results of the blocks have to be joined.
+	bool partial_block() const
+	{
+		return partial_block_;
+	}
+
+	// Multi-volume databases consist of a manifest file, which holds the header,
+	// the taxonomy sections and a table of the volumes. Each volume is a database
+	// file of its own, and its sequences are numbered from first_seq on.
+	struct Volume
+	{
+		string file_name;
+		uint64_t first_seq, sequences, letters;
+		std::shared_ptr<DatabaseFile> db;
+	};
+
+	bool has_volumes() const
+	{
+		return !volumes_.empty();
+	}
+	// Restricts loading of reference blocks to the given volume numbers.
+	void select_volumes(const vector<string> &volumes);
+	static string volume_file_name(const string &database, size_t volume);
+
+	enum { min_build_required = 74, MIN_DB_VERSION = 2, SEPARATE_TITLES_DB_VERSION = 4, PACKED_DB_VERSION = 5, VOLUMES_DB_VERSION = 6 };
 
 	bool temporary;
 	size_t pos_array_offset;
 	ReferenceHeader ref_header;
 	ReferenceHeader2 header2;
+	DatabaseStatistics statistics;
 
 private:
 	void init();
+	void map();
+	void open_volumes();
+	bool load_volume_seqs(vector<unsigned> &block_to_database_id, size_t max_letters, Sequence_set **dst_seq, String_set<0> **dst_id, bool load_ids, const vector<bool> *filter, unsigned timer_level);
+	MaskRun mask_run(size_t i);
+	void read_mask(uint64_t begin, uint64_t end, Letter *dst);
+
+	std::unique_ptr<MappedFile> mapped_;
+	size_t read_seq_idx_;
+	vector<Volume> volumes_;
+	// Indices of the volumes that reference blocks are loaded from.
+	vector<size_t> search_volumes_;
+	// Position in search_volumes_ for loading blocks, and index into volumes_ for reading
+	// the sequences one by one.
+	size_t search_volume_, read_volume_;
+	bool partial_block_;
+	// Number of mask runs of a packed database, and the run that the next lookup starts from.
+	uint64_t mask_runs_;
+	size_t mask_cursor_;
+
+	friend struct TitleStore;
 
 };
 
@@ -114,11 +214,17 @@ struct ref_seqs
 	static Sequence_set *data_;
 };
 
+struct TitleStore;
+
 struct ref_ids
 {
 	static const String_set<0>& get()
 	{ return *data_; }
+	// Title of a sequence of the current reference block. If the block was
+	// loaded without titles, it is read from the database on demand.
+	static const char* title(size_t block_id);
 	static String_set<0> *data_;
+	static TitleStore *lazy_;
 };
 
 extern Partitioned_histogram ref_hst;
@@ -17,20 +17,27 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ****/
 
 #include <stdint.h>
+#include <atomic>
+#include <thread>
 #include "seed_array.h"
 #include "seed_set.h"
+#include "../util/simd.h"
+#include "../util/system/huge_pages.h"
 
-typedef vector<Array<SeedArray::Entry*, Const::seedp> > PtrSet;
-
-char* SeedArray::alloc_buffer(const Partitioned_histogram &hst)
+template<typename _pos>
+char* BasicSeedArray<_pos>::alloc_buffer(const Partitioned_histogram &hst)
 {
-	return new char[sizeof(Entry) * hst.max_chunk_size()];
+	const size_t size = sizeof(Entry) * hst.max_chunk_size();
+	char *buf = new char[size];
+	HugePages::advise(buf, size);
+	return buf;
 }
 
+template<typename _entry>
 struct BufferedWriter
 {
 	static const unsigned BUFFER_SIZE = 16;
-	BufferedWriter(SeedArray::Entry* const* ptr)
+	BufferedWriter(_entry* const* ptr)
 	{
 		memset(n, 0, sizeof(n));
 		memcpy(this->ptr, ptr, sizeof(this->ptr));
@@ -40,14 +47,14 @@ struct BufferedWriter
 		const unsigned p = seed_partition(key);
 		if (range.contains(p)) {
 			assert(n[p] < BUFFER_SIZE);
-			buf[p][n[p]++] = SeedArray::Entry(seed_partition_offset(key), value);
+			buf[p][n[p]++] = _entry(seed_partition_offset(key), value);
 			if (n[p] == BUFFER_SIZE)
 				flush(p);
 		}
 	}
 	void flush(unsigned p)
 	{
-		memcpy(ptr[p], buf[p], n[p] * sizeof(SeedArray::Entry));
+		memcpy(ptr[p], buf[p], n[p] * sizeof(_entry));
 		ptr[p] += n[p];
 		n[p] = 0;
 	}
@@ -57,13 +64,14 @@ struct BufferedWriter
 			if (n[p] > 0)
 				flush(p);
 	}
-	SeedArray::Entry *ptr[Const::seedp], buf[Const::seedp][BUFFER_SIZE];
+	_entry *ptr[Const::seedp], buf[Const::seedp][BUFFER_SIZE];
 	uint8_t n[Const::seedp];
 };
 
-PtrSet build_iterators(SeedArray &sa, const shape_histogram &hst)
+template<typename _pos>
+vector<Array<typename BasicSeedArray<_pos>::Entry*, Const::seedp>> build_iterators(BasicSeedArray<_pos> &sa, const shape_histogram &hst)
 {
-	PtrSet iterators(hst.size());
+	vector<Array<typename BasicSeedArray<_pos>::Entry*, Const::seedp>> iterators(hst.size());
 	for (unsigned i = 0; i < Const::seedp; ++i)
 		iterators[0][i] = sa.begin(i);
 
@@ -73,11 +81,76 @@ PtrSet build_iterators(SeedArray &sa, const shape_histogram &hst)
 	return iterators;
 }
 
+// Buffers the entries of each seed partition until at least two cache lines are filled,
+// then writes the whole lines of the buffer to the seed array with non-temporal stores.
+// Only the first write of a partition, which aligns the destination to a cache line,
+// and the final flush use regular stores, so the lines written by other threads at the
+// borders of the range of this writer are never streamed.
+template<typename _entry>
+struct StreamingWriter
+{
+	static const unsigned LINE_SIZE = 64, FLUSH_SIZE = 2 * LINE_SIZE, BUFFER_SIZE = FLUSH_SIZE + sizeof(_entry);
+	StreamingWriter(_entry* const* ptr)
+	{
+		memset(n, 0, sizeof(n));
+		for (unsigned p = 0; p < Const::seedp; ++p)
+			this->ptr[p] = (char*)ptr[p];
+	}
+	void push(Packed_seed key, Loc value, const SeedPartitionRange &range)
+	{
+		const unsigned p = seed_partition(key);
+		if (range.contains(p)) {
+			const _entry e(seed_partition_offset(key), value);
+			memcpy(buf[p] + n[p], &e, sizeof(e));
+			n[p] += sizeof(e);
+			if (n[p] >= FLUSH_SIZE)
+				flush_lines(p);
+		}
+	}
+	void flush_lines(unsigned p)
+	{
+		const char *src = buf[p];
+		char *dst = ptr[p];
+		const size_t head = (LINE_SIZE - ((size_t)dst & (LINE_SIZE - 1))) & (LINE_SIZE - 1);
+		memcpy(dst, src, head);
+		src += head;
+		dst += head;
+		for (size_t i = (n[p] - head) / LINE_SIZE; i > 0; --i) {
+#ifdef __SSE2__
+			for (unsigned j = 0; j < LINE_SIZE / 16; ++j)
+				_mm_stream_si128((__m128i*)dst + j, _mm_loadu_si128((const __m128i*)src + j));
+#else
+			memcpy(dst, src, LINE_SIZE);
+#endif
+			src += LINE_SIZE;
+			dst += LINE_SIZE;
+		}
+		n[p] = uint8_t(buf[p] + n[p] - src);
+		memmove(buf[p], src, n[p]);
+		ptr[p] = dst;
+	}
+	void flush()
+	{
+		for (unsigned p = 0; p < Const::seedp; ++p)
+			if (n[p] > 0) {
+				memcpy(ptr[p], buf[p], n[p]);
+				ptr[p] += n[p];
+				n[p] = 0;
+			}
+#ifdef __SSE2__
+		_mm_sfence();
+#endif
+	}
+	char *ptr[Const::seedp], buf[Const::seedp][BUFFER_SIZE];
+	uint8_t n[Const::seedp];
+};
+
+template<typename _writer, typename _entry>
 struct BuildCallback
 {
-	BuildCallback(const SeedPartitionRange &range, SeedArray::Entry* const* ptr) :
+	BuildCallback(const SeedPartitionRange &range, _entry* const* ptr) :
 		range(range),
-		it(new BufferedWriter(ptr))
+		it(new _writer(ptr))
 	{ }
 	bool operator()(uint64_t seed, uint64_t pos, size_t shape)
 	{
@@ -93,24 +166,262 @@ struct BuildCallback
 		delete it;
 	}
 	SeedPartitionRange range;
-	BufferedWriter *it;
+	_writer *it;
 };
 
+template<typename _pos>
 template<typename _filter>
-SeedArray::SeedArray(const Sequence_set &seqs, size_t shape, const shape_histogram &hst, const SeedPartitionRange &range, const vector<size_t> &seq_partition, char *buffer, const _filter *filter) :
+BasicSeedArray<_pos>::BasicSeedArray(const Sequence_set &seqs, size_t shape, const shape_histogram &hst, const SeedPartitionRange &range, const vector<size_t> &seq_partition, char *buffer, const _filter *filter) :
 	data_((Entry*)buffer)
 {
 	begin_[range.begin()] = 0;
 	for (size_t i = range.begin(); i < range.end(); ++i)
 		begin_[i + 1] = begin_[i] + partition_size(hst, i);
+	if (numa_placement())
+		place(range);
+
+	const vector<Array<Entry*, Const::seedp>> iterators(build_iterators(*this, hst));
+	if (config.streaming_seeds) {
+		PtrVector<BuildCallback<StreamingWriter<Entry>, Entry>> cb;
+		for (size_t i = 0; i < seq_partition.size() - 1; ++i)
+			cb.push_back(new BuildCallback<StreamingWriter<Entry>, Entry>(range, iterators[i].begin()));
+		seqs.enum_seeds(cb, seq_partition, shape, shape + 1, filter);
+	}
+	else {
+		PtrVector<BuildCallback<BufferedWriter<Entry>, Entry>> cb;
+		for (size_t i = 0; i < seq_partition.size() - 1; ++i)
+			cb.push_back(new BuildCallback<BufferedWriter<Entry>, Entry>(range, iterators[i].begin()));
+		seqs.enum_seeds(cb, seq_partition, shape, shape + 1, filter);
+	}
+}
 
-	PtrSet iterators(build_iterators(*this, hst));
-	PtrVector<BuildCallback> cb;
-	for (size_t i = 0; i < seq_partition.size() - 1; ++i)
-		cb.push_back(new BuildCallback(range, iterators[i].begin()));
+// Seeds of one sequence partition, collected in blocks per seed partition. Blocks are
+// kept for reuse after the seeds have been copied. Their size in bytes is fixed, so that
+// blocks can be reused for entries of any size.
+struct SeedBlocks
+{
+	SeedBlocks(size_t block_bytes):
+		block_bytes_(block_bytes)
+	{
+		memset(size, 0, sizeof(size));
+	}
+	~SeedBlocks()
+	{
+		clear();
+		for (char *b : free_)
+			delete[] b;
+	}
+	template<typename _entry>
+	void append(unsigned p, const _entry *src, size_t n)
+	{
+		const size_t block_size = block_bytes_ / sizeof(_entry);
+		while (n > 0) {
+			const size_t fill = size[p] % block_size;
+			if (fill == 0) {
+				if (free_.empty())
+					blocks[p].push_back(new char[block_bytes_]);
+				else {
+					blocks[p].push_back(free_.back());
+					free_.pop_back();
+				}
+			}
+			const size_t k = std::min(n, block_size - fill);
+			memcpy((_entry*)blocks[p].back() + fill, src, k * sizeof(_entry));
+			size[p] += k;
+			src += k;
+			n -= k;
+		}
+	}
+	template<typename _entry>
+	_entry* copy(unsigned p, _entry *dst) const
+	{
+		const size_t block_size = block_bytes_ / sizeof(_entry);
+		for (size_t i = 0, n = size[p]; n > 0; ++i) {
+			const size_t k = std::min(n, block_size);
+			memcpy(dst, blocks[p][i], k * sizeof(_entry));
+			dst += k;
+			n -= k;
+		}
+		return dst;
+	}
+	void clear()
+	{
+		for (unsigned p = 0; p < Const::seedp; ++p) {
+			free_.insert(free_.end(), blocks[p].begin(), blocks[p].end());
+			blocks[p].clear();
+			size[p] = 0;
+		}
+	}
+	size_t allocated() const
+	{
+		size_t n = free_.size();
+		for (unsigned p = 0; p < Const::seedp; ++p)
+			n += blocks[p].size();
+		return n * block_bytes_;
+	}
+	vector<char*> blocks[Const::seedp];
+	size_t size[Const::seedp];
+private:
+	const size_t block_bytes_;
+	vector<char*> free_;
+};
+
+SeedBuffers::SeedBuffers(size_t letters, size_t seq_partitions):
+	data_(nullptr),
+	capacity_(0),
+	block_bytes_(block_bytes(letters, seq_partitions))
+{}
+
+SeedBuffers::~SeedBuffers()
+{
+	delete[] data_;
+}
+
+char* SeedBuffers::data(size_t bytes)
+{
+	if (bytes > capacity_) {
+		delete[] data_;
+		capacity_ = bytes + bytes / 8;
+		data_ = new char[capacity_];
+		HugePages::advise(data_, capacity_);
+	}
+	return data_;
+}
+
+size_t SeedBuffers::allocated() const
+{
+	size_t n = capacity_;
+	for (const SeedBlocks *b : blocks)
+		n += b->allocated();
+	return n;
+}
+
+size_t SeedBuffers::block_bytes(size_t letters, size_t seq_partitions)
+{
+	static const size_t MIN_BLOCK_ENTRIES = 64, MAX_BLOCK_ENTRIES = 4096;
+	const size_t cell_entries = letters / std::max(seq_partitions, (size_t)1) / Const::seedp;
+	size_t n = MIN_BLOCK_ENTRIES;
+	while (n < MAX_BLOCK_ENTRIES && n * 8 < cell_entries)
+		n *= 2;
+	return n * sizeof(SeedArray::Entry);
+}
+
+size_t SeedBuffers::bytes(size_t entries, size_t entry_size, size_t letters, size_t seq_partitions, unsigned index_chunks)
+{
+	// The array grows by an eighth on reallocation, and the blocks hold a second copy of the entries.
+	const size_t cells = seq_partitions * ((Const::seedp + index_chunks - 1) / index_chunks);
+	return (size_t)(entry_size * entries * 2.125) + cells * block_bytes(letters, seq_partitions);
+}
+
+template<typename _entry>
+struct CollectCallback
+{
+	static const unsigned BUFFER_SIZE = 16;
+	CollectCallback(const SeedPartitionRange &range, SeedBlocks *out) :
+		range(range),
+		out(out)
+	{
+		memset(n, 0, sizeof(n));
+	}
+	bool operator()(uint64_t seed, uint64_t pos, size_t shape)
+	{
+		const unsigned p = seed_partition(seed);
+		if (range.contains(p)) {
+			buf[p][n[p]++] = _entry(seed_partition_offset(seed), pos);
+			if (n[p] == BUFFER_SIZE) {
+				out->append(p, buf[p], BUFFER_SIZE);
+				n[p] = 0;
+			}
+		}
+		return true;
+	}
+	void finish()
+	{
+		for (unsigned p = range.begin(); p < range.end(); ++p)
+			out->append(p, buf[p], n[p]);
+	}
+	SeedPartitionRange range;
+	SeedBlocks *out;
+	_entry buf[Const::seedp][BUFFER_SIZE];
+	uint8_t n[Const::seedp];
+};
+
+template<typename _pos>
+static void copy_worker(std::atomic<unsigned> *next, const SeedPartitionRange *range, const PtrVector<SeedBlocks> *blocks, BasicSeedArray<_pos> *sa)
+{
+	unsigned p;
+	while ((p = (*next)++) < range->end()) {
+		typename BasicSeedArray<_pos>::Entry *dst = sa->begin(p);
+		for (const SeedBlocks *b : *blocks)
+			dst = b->copy(p, dst);
+	}
+}
+
+template<typename _pos>
+template<typename _filter>
+BasicSeedArray<_pos>::BasicSeedArray(const Sequence_set &seqs, size_t shape, const SeedPartitionRange &range, const vector<size_t> &seq_partition, SeedBuffers &buffers, const _filter *filter)
+{
+	PtrVector<SeedBlocks> &blocks = buffers.blocks;
+	PtrVector<CollectCallback<Entry>> cb;
+	for (size_t i = 0; i < seq_partition.size() - 1; ++i) {
+		if (i == blocks.size())
+			blocks.push_back(new SeedBlocks(buffers.block_bytes()));
+		cb.push_back(new CollectCallback<Entry>(range, &blocks[i]));
+	}
 	seqs.enum_seeds(cb, seq_partition, shape, shape + 1, filter);
+
+	begin_[range.begin()] = 0;
+	for (unsigned p = range.begin(); p < range.end(); ++p) {
+		begin_[p + 1] = begin_[p];
+		for (const SeedBlocks *b : blocks)
+			begin_[p + 1] += b->size[p];
+	}
+	data_ = (Entry*)buffers.data(begin_[range.end()] * sizeof(Entry));
+	if (numa_placement())
+		place(range);
+
+	std::atomic<unsigned> next(range.begin());
+	vector<std::thread> threads;
+	for (size_t i = 0; i < config.threads_; ++i)
+		threads.emplace_back(copy_worker<_pos>, &next, &range, &blocks, this);
+	for (auto &t : threads)
+		t.join();
+	for (SeedBlocks *b : blocks)
+		b->clear();
+}
+
+template<typename _pos>
+BasicSeedArray<_pos>::BasicSeedArray(Entry *data, const uint64_t *partition_begin, const SeedPartitionRange &range) :
+	data_(data + partition_begin[range.begin()])
+{
+	for (size_t i = range.begin(); i <= range.end(); ++i)
+		begin_[i] = partition_begin[i] - partition_begin[range.begin()];
+}
+
+template<typename _pos>
+void BasicSeedArray<_pos>::place(const SeedPartitionRange &range)
+{
+	for (unsigned node = 0; node < Numa::nodes(); ++node) {
+		const size_t begin = Numa::split(range.begin(), range.end(), node), end = Numa::split(range.begin(), range.end(), node + 1);
+		Numa::bind(data_ + begin_[begin], (begin_[end] - begin_[begin]) * sizeof(Entry), node);
+	}
 }
 
-template SeedArray::SeedArray(const Sequence_set &, size_t, const shape_histogram &, const SeedPartitionRange &, const vector<size_t>&, char *buffer, const No_filter *);
-template SeedArray::SeedArray(const Sequence_set &, size_t, const shape_histogram &, const SeedPartitionRange &, const vector<size_t>&, char *buffer, const Seed_set *);
-template SeedArray::SeedArray(const Sequence_set &, size_t, const shape_histogram &, const SeedPartitionRange &, const vector<size_t>&, char *buffer, const Hashed_seed_set *);
\ No newline at end of file
+template struct BasicSeedArray<Packed_loc>;
+template struct BasicSeedArray<uint32_t>;
+template BasicSeedArray<Packed_loc>::BasicSeedArray(const Sequence_set &, size_t, const shape_histogram &, const SeedPartitionRange &, const vector<size_t>&, char *buffer, const No_filter *);
+template BasicSeedArray<Packed_loc>::BasicSeedArray(const Sequence_set &, size_t, const shape_histogram &, const SeedPartitionRange &, const vector<size_t>&, char *buffer, const Seed_set *);
+template BasicSeedArray<Packed_loc>::BasicSeedArray(const Sequence_set &, size_t, const shape_histogram &, const SeedPartitionRange &, const vector<size_t>&, char *buffer, const Hashed_seed_set *);
+template BasicSeedArray<Packed_loc>::BasicSeedArray(const Sequence_set &, size_t, const shape_histogram &, const SeedPartitionRange &, const vector<size_t>&, char *buffer, const Bloom_seed_set *);
+template BasicSeedArray<Packed_loc>::BasicSeedArray(const Sequence_set &, size_t, const SeedPartitionRange &, const vector<size_t>&, SeedBuffers &, const No_filter *);
+template BasicSeedArray<Packed_loc>::BasicSeedArray(const Sequence_set &, size_t, const SeedPartitionRange &, const vector<size_t>&, SeedBuffers &, const Seed_set *);
+template BasicSeedArray<Packed_loc>::BasicSeedArray(const Sequence_set &, size_t, const SeedPartitionRange &, const vector<size_t>&, SeedBuffers &, const Hashed_seed_set *);
+template BasicSeedArray<Packed_loc>::BasicSeedArray(const Sequence_set &, size_t, const SeedPartitionRange &, const vector<size_t>&, SeedBuffers &, const Bloom_seed_set *);
+template BasicSeedArray<uint32_t>::BasicSeedArray(const Sequence_set &, size_t, const shape_histogram &, const SeedPartitionRange &, const vector<size_t>&, char *buffer, const No_filter *);
+template BasicSeedArray<uint32_t>::BasicSeedArray(const Sequence_set &, size_t, const shape_histogram &, const SeedPartitionRange &, const vector<size_t>&, char *buffer, const Seed_set *);
+template BasicSeedArray<uint32_t>::BasicSeedArray(const Sequence_set &, size_t, const shape_histogram &, const SeedPartitionRange &, const vector<size_t>&, char *buffer, const Hashed_seed_set *);
+template BasicSeedArray<uint32_t>::BasicSeedArray(const Sequence_set &, size_t, const shape_histogram &, const SeedPartitionRange &, const vector<size_t>&, char *buffer, const Bloom_seed_set *);
+template BasicSeedArray<uint32_t>::BasicSeedArray(const Sequence_set &, size_t, const SeedPartitionRange &, const vector<size_t>&, SeedBuffers &, const No_filter *);
+template BasicSeedArray<uint32_t>::BasicSeedArray(const Sequence_set &, size_t, const SeedPartitionRange &, const vector<size_t>&, SeedBuffers &, const Seed_set *);
+template BasicSeedArray<uint32_t>::BasicSeedArray(const Sequence_set &, size_t, const SeedPartitionRange &, const vector<size_t>&, SeedBuffers &, const Hashed_seed_set *);
+template BasicSeedArray<uint32_t>::BasicSeedArray(const Sequence_set &, size_t, const SeedPartitionRange &, const vector<size_t>&, SeedBuffers &, const Bloom_seed_set *);
\ No newline at end of file
@@ -21,13 +21,19 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "seed_histogram.h"
 #include "../basic/packed_loc.h"
+#include "../util/system/numa.h"
+
+struct SeedBuffers;
 
 #pragma pack(1)
 
-struct SeedArray
+// Seed array of one shape and index chunk. The entries hold the seed bits above the seed
+// partition as the key and the position of the seed in the sequence set, stored as _pos.
+template<typename _pos>
+struct BasicSeedArray
 {
 
-	typedef Packed_loc _pos;
+	typedef _pos Pos;
 
 	struct Entry
 	{
@@ -45,7 +51,14 @@ struct SeedArray
 	} PACKED_ATTRIBUTE;
 
 	template<typename _filter>
-	SeedArray(const Sequence_set &seqs, size_t shape, const shape_histogram &hst, const SeedPartitionRange &range, const vector<size_t> &seq_partition, char *buffer, const _filter *filter);
+	BasicSeedArray(const Sequence_set &seqs, size_t shape, const shape_histogram &hst, const SeedPartitionRange &range, const vector<size_t> &seq_partition, char *buffer, const _filter *filter);
+	// Builds the array in a single pass over the seeds without a histogram. The entries are
+	// collected in blocks per sequence partition and seed partition, which are then copied
+	// into the array of the buffers, in the same order as by the constructor above.
+	template<typename _filter>
+	BasicSeedArray(const Sequence_set &seqs, size_t shape, const SeedPartitionRange &range, const vector<size_t> &seq_partition, SeedBuffers &buffers, const _filter *filter);
+	// Uses prebuilt entries of all seed partitions, with partition i starting at data[partition_begin[i]].
+	BasicSeedArray(Entry *data, const uint64_t *partition_begin, const SeedPartitionRange &range);
 
 	Entry* begin(unsigned i)
 	{
@@ -66,6 +79,9 @@ struct SeedArray
 
 private:
 
+	// Places the seed partitions of each node share of the range on that node.
+	void place(const SeedPartitionRange &range);
+
 	Entry *data_;
 	size_t begin_[Const::seedp + 1];
 
@@ -73,4 +89,55 @@ private:
 
 #pragma pack()
 
+// Seed array with 40 bit positions, as stored in the seed index.
+typedef BasicSeedArray<Packed_loc> SeedArray;
+// Seed array with 32 bit positions, which takes 8 instead of 9 bytes per entry. The keys
+// need all 32 bits with the default shapes and reduction, so a smaller entry would
+// require compressed keys.
+typedef BasicSeedArray<uint32_t> CompactSeedArray;
+
+// Returns if the seed partitions of a range are split evenly over the NUMA nodes (--numa), as
+// given by Numa::split, both for placing the seed arrays and for assigning them to threads.
+inline bool numa_placement()
+{
+	return config.numa && Numa::nodes() > 1;
+}
+
+// Returns if the positions of the sequence set fit into the entries of a CompactSeedArray.
+inline bool compact_seeds(const Sequence_set &seqs)
+{
+	return seqs.raw_len() <= (size_t)UINT32_MAX;
+}
+
+struct SeedBlocks;
+
+// Memory for building seed arrays in a single pass, which is kept for the seed arrays
+// of all shapes and index chunks of a block.
+struct SeedBuffers
+{
+	// The blocks are sized for seed arrays of a block with the given number of letters that
+	// is enumerated in the given number of sequence partitions.
+	SeedBuffers(size_t letters, size_t seq_partitions);
+	~SeedBuffers();
+	// Returns the array memory of at least the given size in bytes.
+	char* data(size_t bytes);
+	// Bytes currently allocated for the array and the blocks.
+	size_t allocated() const;
+	size_t block_bytes() const
+	{
+		return block_bytes_;
+	}
+	// Size in bytes of the blocks that collect the entries of one sequence partition and seed
+	// partition. They hold about an eighth of the entries expected for such a cell, so that
+	// the partly filled last block of each cell adds little memory.
+	static size_t block_bytes(size_t letters, size_t seq_partitions);
+	// Size in bytes of the buffers for a seed array with the given number of entries, including
+	// the last block of each cell of an index chunk.
+	static size_t bytes(size_t entries, size_t entry_size, size_t letters, size_t seq_partitions, unsigned index_chunks);
+	PtrVector<SeedBlocks> blocks;
+private:
+	char *data_;
+	size_t capacity_, block_bytes_;
+};
+
 #endif
\ No newline at end of file
@@ -0,0 +1,246 @@
+/****
+DIAMOND protein aligner
+Copyright (C) 2013-2019 Benjamin Buchfink <buchfink@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+****/
+
+#include <algorithm>
+#include <sstream>
+#include <string.h>
+#include "seed_index.h"
+#include "../basic/config.h"
+#include "../basic/shape_config.h"
+#include "../basic/masking.h"
+#include "../search/align_range.h"
+#include "../util/io/output_file.h"
+#include "../util/system/system.h"
+#include "../util/util.h"
+#include "../util/string/string.h"
+
+using std::string;
+using std::vector;
+using std::endl;
+using std::unique_ptr;
+
+SeedIndex *ref_seed_index = nullptr;
+
+string SeedIndex::file_name(const string &database)
+{
+	string s = database;
+	if (ends_with(s, ".dmnd"))
+		s.erase(s.length() - 5);
+	return s + ".seed_idx";
+}
+
+// Settings that determine the block boundaries and the content of the seed arrays.
+string SeedIndex::signature()
+{
+	std::stringstream ss;
+	ss << "block_size=" << (size_t)(config.chunk_size * 1e9)
+		<< " shapes=" << ::shapes
+		<< " reduction=" << Reduction::reduction
+		<< " masking=" << config.masking;
+	if (config.masking == 1)
+		ss << " tantan=" << config.tantan_minMaskProb << ',' << config.tantan_maxRepeatOffset << ',' << config.tantan_ungapped
+			<< " scoring=" << score_matrix;
+	return ss.str();
+}
+
+// Computes the seed arrays of a masked reference block. For each shape, the offsets
+// of the seed partitions are passed to partitions, followed by the entries of each
+// index chunk passed to entries.
+template<typename _partitions, typename _entries>
+static void build_block(const Sequence_set &seqs, _partitions partitions, _entries entries)
+{
+	task_timer timer("Building reference histograms");
+	const Partitioned_histogram hst(seqs, false, &no_filter);
+	timer.go("Allocating buffers");
+	char *buffer = SeedArray::alloc_buffer(hst);
+	const ::partition<unsigned> p(Const::seedp, config.lowmem);
+	for (unsigned shape = 0; shape < ::shapes.count(); ++shape) {
+		timer.go("Building reference seed arrays");
+		vector<uint64_t> partition_begin(Const::seedp + 1);
+		for (unsigned i = 0; i < Const::seedp; ++i)
+			partition_begin[i + 1] = partition_begin[i] + partition_size(hst.get(shape), i);
+		partitions(partition_begin);
+		for (unsigned chunk = 0; chunk < p.parts; ++chunk) {
+			const SeedPartitionRange range(p.getMin(chunk), p.getMax(chunk));
+			const SeedArray sa(seqs, shape, hst.get(shape), range, hst.partition(), buffer, &no_filter);
+			entries(sa.begin(range.begin()), partition_begin[range.end()] - partition_begin[range.begin()]);
+		}
+	}
+	delete[] buffer;
+}
+
+void SeedIndex::build(const string &database)
+{
+	task_timer timer("Opening the database");
+	DatabaseFile db(database);
+	if (config.mode_very_sensitive)
+		Config::set_option(config.chunk_size, 0.4);
+	else
+		Config::set_option(config.chunk_size, 2.0);
+	Config::set_option(config.lowmem, 4u);
+	config.algo = Config::double_indexed;
+	setup_search_cont();
+	setup_search();
+	timer.finish();
+	message_stream << "Seed index file: " << file_name(database) << endl;
+	verbose_stream << "Block size = " << (size_t)(config.chunk_size * 1e9) << endl;
+
+	OutputFile out(file_name(database));
+	const string sig = signature();
+	uint32_t blocks = 0;
+	const uint32_t shape_count = ::shapes.count();
+	uint64_t directory_offset = 0;
+	const auto write_header = [&]() {
+		out << (unsigned long long)MAGIC_NUMBER << (unsigned)CURRENT_VERSION;
+		out.write(db.header2.hash, sizeof(db.header2.hash));
+		out << sig << (unsigned)blocks << (unsigned)shape_count << (unsigned long long)directory_offset;
+	};
+	write_header();
+
+	vector<uint64_t> directory;
+	vector<unsigned> block_to_database_id;
+	Sequence_set *seqs;
+	String_set<0> *ids;
+
+	while (db.load_seqs(block_to_database_id, (size_t)(config.chunk_size * 1e9), &seqs, &ids, false)) {
+		seqs->print_stats();
+		if (config.masking == 1) {
+			timer.go("Masking reference");
+			mask_seqs(*seqs, Masking::get());
+		}
+		timer.finish();
+		build_block(*seqs, [&](const vector<uint64_t> &partition_begin) {
+			directory.push_back(out.tell());
+			out.write_raw(partition_begin);
+		}, [&](const SeedArray::Entry *entries, size_t n) {
+			out.write(entries, n);
+		});
+		delete seqs;
+		block_to_database_id.clear();
+		++blocks;
+	}
+
+	timer.go("Writing directory");
+	directory_offset = out.tell();
+	out.write_raw(directory);
+	out.seek(0);
+	write_header();
+	out.close();
+	timer.finish();
+	message_stream << "Seed index blocks: " << blocks << ", shapes: " << shape_count << endl;
+}
+
+SeedIndex::SeedIndex(const string &file_name)
+{
+	InputFile in(file_name);
+	unsigned long long magic_number, directory_offset;
+	unsigned version;
+	in >> magic_number;
+	if (magic_number != MAGIC_NUMBER)
+		throw std::runtime_error("File is not a DIAMOND seed index: " + file_name);
+	in >> version;
+	if (version > CURRENT_VERSION)
+		throw std::runtime_error("Seed index requires a newer version of DIAMOND: " + file_name);
+	if (in.read(db_hash_, sizeof(db_hash_)) != sizeof(db_hash_))
+		throw std::runtime_error("Error reading seed index: " + file_name);
+	in >> signature_ >> blocks_ >> shapes_ >> directory_offset;
+	directory_.resize((size_t)blocks_ * shapes_);
+	in.seek(directory_offset);
+	if (in.read(directory_.data(), directory_.size()) != directory_.size())
+		throw std::runtime_error("Error reading seed index: " + file_name);
+	in.close();
+	file_.reset(new MappedFile(file_name));
+}
+
+SeedIndex::SeedIndex(const vector<const Sequence_set*> &blocks):
+	signature_(signature()),
+	blocks_((uint32_t)blocks.size()),
+	shapes_(::shapes.count())
+{
+	memset(db_hash_, 0, sizeof(db_hash_));
+	for (const Sequence_set *seqs : blocks)
+		build_block(*seqs, [this](const vector<uint64_t> &partition_begin) {
+			directory_.push_back(memory_.size());
+			memory_.insert(memory_.end(), (const char*)partition_begin.data(), (const char*)(partition_begin.data() + partition_begin.size()));
+		}, [this](const SeedArray::Entry *entries, size_t n) {
+			memory_.insert(memory_.end(), (const char*)entries, (const char*)(entries + n));
+		});
+}
+
+bool SeedIndex::compatible(const DatabaseFile &db, string &reason) const
+{
+	if (memcmp(db_hash_, db.header2.hash, sizeof(db_hash_)) != 0) {
+		reason = "database hash mismatch";
+		return false;
+	}
+	if (shapes_ != ::shapes.count() || signature_ != signature()) {
+		reason = "index built with different settings";
+		log_stream << "Seed index settings: " << signature_ << endl;
+		return false;
+	}
+	return true;
+}
+
+SeedIndex* SeedIndex::load(const DatabaseFile &db)
+{
+	const string f = file_name(config.database);
+	if (!exists(f))
+		return nullptr;
+	task_timer timer("Opening the seed index");
+	unique_ptr<SeedIndex> index(new SeedIndex(f));
+	timer.finish();
+	string reason;
+	if (!index->compatible(db, reason)) {
+		message_stream << "Seed index not used: " << reason << endl;
+		return nullptr;
+	}
+	message_stream << "Seed index: " << f << endl;
+	return index.release();
+}
+
+const char* SeedIndex::data(size_t offset) const
+{
+	return file_ ? file_->data(offset) : memory_.data() + offset;
+}
+
+const uint64_t* SeedIndex::partition_begin(unsigned block, unsigned shape) const
+{
+	if (block >= blocks_ || shape >= shapes_)
+		throw std::runtime_error("Seed index does not match the reference blocks.");
+	return (const uint64_t*)data(directory_[(size_t)block * shapes_ + shape]);
+}
+
+SeedArray* SeedIndex::seed_array(unsigned block, unsigned shape, const SeedPartitionRange &range)
+{
+	const uint64_t *begin = partition_begin(block, shape);
+	SeedArray::Entry *data = (SeedArray::Entry*)(begin + Const::seedp + 1);
+	if (!file_)
+		return new SeedArray(data, begin, range);
+	const size_t offset = (const char*)(data + begin[range.begin()]) - file_->data();
+	file_->prefetch(offset, (begin[range.end()] - begin[range.begin()]) * sizeof(SeedArray::Entry));
+	return new SeedArray(data, begin, range);
+}
+
+void SeedIndex::release(unsigned block, unsigned shape, const SeedPartitionRange &range)
+{
+	if (!file_)
+		return;
+	const uint64_t *begin = partition_begin(block, shape);
+	const SeedArray::Entry *data = (const SeedArray::Entry*)(begin + Const::seedp + 1);
+	file_->release((const char*)(data + begin[range.begin()]) - file_->data(), (begin[range.end()] - begin[range.begin()]) * sizeof(SeedArray::Entry));
+}
@@ -0,0 +1,79 @@
+/****
+DIAMOND protein aligner
+Copyright (C) 2013-2019 Benjamin Buchfink <buchfink@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+****/
+
+#ifndef SEED_INDEX_H_
+#define SEED_INDEX_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include "seed_array.h"
+#include "reference.h"
+#include "../util/io/mapped_file.h"
+
+// Precomputed reference seed arrays for the double-indexed search, stored in
+// a file next to the database. The file holds one seed array per reference
+// block and shape, with all seed partitions in order, so that any index chunk
+// can be used in place without enumerating the reference seeds. The same layout
+// can be built in memory for reference blocks that are kept loaded.
+struct SeedIndex
+{
+
+	enum { CURRENT_VERSION = 1 };
+	static constexpr uint64_t MAGIC_NUMBER = 0x6f2a915c3be4d107llu;
+
+	SeedIndex(const std::string &file_name);
+	// Builds the seed arrays of masked reference blocks in memory.
+	SeedIndex(const std::vector<const Sequence_set*> &blocks);
+	SeedIndex(const SeedIndex&) = delete;
+	SeedIndex& operator=(const SeedIndex&) = delete;
+
+	// Returns a seed array for the index chunk that points into the mapping or
+	// the memory of the index. Its entries must only be read, so the hash join
+	// writes the reference results into a separate buffer.
+	SeedArray* seed_array(unsigned block, unsigned shape, const SeedPartitionRange &range);
+	// Drops the pages of a seed array from the process after it has been used.
+	void release(unsigned block, unsigned shape, const SeedPartitionRange &range);
+	bool compatible(const DatabaseFile &db, std::string &reason) const;
+
+	static std::string file_name(const std::string &database);
+	static std::string signature();
+	static void build(const std::string &database);
+	// Opens the seed index of the database if it exists and matches the
+	// current search settings.
+	static SeedIndex* load(const DatabaseFile &db);
+
+private:
+
+	const char* data(size_t offset) const;
+	const uint64_t* partition_begin(unsigned block, unsigned shape) const;
+
+	std::unique_ptr<MappedFile> file_;
+	std::vector<char> memory_;
+	char db_hash_[16];
+	std::string signature_;
+	uint32_t blocks_, shapes_;
+	std::vector<uint64_t> directory_;
+
+};
+
+// Seed index used for the current search, or nullptr if none.
+extern SeedIndex *ref_seed_index;
+
+#endif
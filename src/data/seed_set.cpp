@@ -20,6 +20,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "../util/ptr_vector.h"
 
 No_filter no_filter;
+std::atomic<uint64_t> MinimizerStats::seeds(0), MinimizerStats::sampled(0);
 
 struct Seed_set_callback
 {
@@ -79,4 +80,30 @@ Hashed_seed_set::Hashed_seed_set(const Sequence_set &seqs)
 	seqs.enum_seeds(v, seqs.partition(1), 0, shapes.count(), &no_filter);
 	for (size_t i = 0; i < shapes.count(); ++i)
 		log_stream << "Shape=" << i << " Hash_table_size=" << data_[i].size() << " load=" << data_[i].load() << endl;
+}
+
+struct Bloom_seed_set_callback
+{
+	Bloom_seed_set_callback(BlockedBloomFilter &dst):
+		dst(dst)
+	{}
+	bool operator()(uint64_t seed, uint64_t pos, uint64_t shape)
+	{
+		dst.insert_atomic(Bloom_seed_set::hash(seed, shape));
+		return true;
+	}
+	void finish()
+	{}
+	BlockedBloomFilter &dst;
+};
+
+Bloom_seed_set::Bloom_seed_set(const Sequence_set &seqs, double bits_per_seed):
+	filter_(seqs.letters() * shapes.count(), bits_per_seed)
+{
+	const vector<size_t> p = seqs.partition(config.threads_);
+	PtrVector<Bloom_seed_set_callback> v;
+	for (size_t i = 0; i < p.size() - 1; ++i)
+		v.push_back(new Bloom_seed_set_callback(filter_));
+	seqs.enum_seeds(v, p, 0, shapes.count(), &no_filter);
+	log_stream << "Seed filter size = " << filter_.bytes() << " bytes" << endl;
 }
\ No newline at end of file
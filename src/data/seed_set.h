@@ -23,6 +23,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "sequence_set.h"
 #include "../util/hash_table.h"
 #include "../util/ptr_vector.h"
+#include "../util/hash_function.h"
+#include "../util/data_structures/bloom_filter.h"
 
 struct Seed_set
 {
@@ -51,4 +53,40 @@ private:
 	PtrVector<PHash_set<Modulo2, No_hash> > data_;
 };
 
+// Seeds of all shapes of a sequence set in a blocked Bloom filter. False positives only let
+// through reference seeds that match no query seed, which the seed join then drops.
+struct Bloom_seed_set
+{
+	Bloom_seed_set(const Sequence_set &seqs, double bits_per_seed = 16.0);
+	bool contains(uint64_t key, uint64_t shape) const
+	{
+		return filter_.contains(hash(key, shape));
+	}
+	void contains(const uint64_t *keys, const size_t *shapes, size_t n, bool *out) const
+	{
+		uint64_t h[BATCH_SIZE];
+		for (size_t i = 0; i < n; i += BATCH_SIZE) {
+			const size_t m = std::min(n - i, (size_t)BATCH_SIZE);
+			for (size_t j = 0; j < m; ++j)
+				h[j] = hash(keys[i + j], shapes[i + j]);
+			filter_.contains(h, m, out + i);
+		}
+	}
+	size_t bytes() const
+	{
+		return filter_.bytes();
+	}
+	static uint64_t hash(uint64_t key, uint64_t shape)
+	{
+		return murmur_hash()(key ^ (shape << 60));
+	}
+private:
+	enum { BATCH_SIZE = 64 };
+	BlockedBloomFilter filter_;
+};
+
+template<>
+struct Batched_filter<Bloom_seed_set> : std::true_type
+{};
+
 #endif
\ No newline at end of file
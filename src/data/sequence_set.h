@@ -24,21 +24,90 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <algorithm>
 #include <queue>
 #include <thread>
+#include <type_traits>
 #include "../basic/sequence.h"
 #include "string_set.h"
 #include "../util/thread.h"
 #include "../basic/shape_config.h"
 #include "../basic/seed_iterator.h"
 #include "../util/ptr_vector.h"
+#include "minimizer.h"
 
 using std::cout;
 using std::endl;
 using std::pair;
 
+struct No_filter
+{
+	bool contains(uint64_t seed, uint64_t shape) const
+	{
+		return true;
+	}
+};
+
+extern No_filter no_filter;
+
+// Filters for which this is true are probed for batches of seeds through FilterBatchCallback,
+// using a member contains(keys, shapes, n, out), instead of one seed at a time.
+template<typename _filter>
+struct Batched_filter : std::false_type
+{};
+
+// Collects the seeds enumerated for the callback _f in batches and passes on those that are
+// contained in the filter, in the order of enumeration.
+template<typename _f, typename _filter>
+struct FilterBatchCallback
+{
+
+	FilterBatchCallback(_f &f, const _filter *filter) :
+		f_(f),
+		filter_(filter),
+		n_(0)
+	{}
+
+	bool operator()(uint64_t seed, uint64_t pos, size_t shape)
+	{
+		seed_[n_] = seed;
+		pos_[n_] = pos;
+		shape_[n_] = shape;
+		return ++n_ < BATCH_SIZE || flush();
+	}
+
+	void finish()
+	{
+		flush();
+		f_.finish();
+	}
+
+private:
+
+	enum { BATCH_SIZE = 64 };
+
+	bool flush()
+	{
+		filter_->contains(seed_, shape_, n_, hit_);
+		const size_t n = n_;
+		n_ = 0;
+		for (size_t i = 0; i < n; ++i)
+			if (hit_[i] && !f_(seed_[i], pos_[i], shape_[i]))
+				return false;
+		return true;
+	}
+
+	_f &f_;
+	const _filter *filter_;
+	size_t n_;
+	uint64_t seed_[BATCH_SIZE], pos_[BATCH_SIZE];
+	size_t shape_[BATCH_SIZE];
+	bool hit_[BATCH_SIZE];
+
+};
+
 struct Sequence_set : public String_set<sequence::DELIMITER, 1>
 {
 
-	Sequence_set()
+	Sequence_set():
+		minimizer_window(0)
 	{ }
 	
 	void print_stats() const
@@ -141,18 +210,49 @@ struct Sequence_set : public String_set<sequence::DELIMITER, 1>
 	template <typename _f, typename _filter>
 	void enum_seeds(PtrVector<_f> &f, const vector<size_t> &p, size_t shape_begin, size_t shape_end, const _filter *filter) const
 	{
-		std::vector<std::thread> threads;
-		for (unsigned i = 0; i < f.size(); ++i)
-			threads.emplace_back(enum_seeds_worker<_f, _filter>, &f[i], this, (unsigned)p[i], (unsigned)p[i + 1], std::make_pair(shape_begin, shape_end), filter);
-		for (auto &t : threads)
-			t.join();
+		if (minimizer_window > 1) {
+			PtrVector<MinimizerCallback<_f, _filter>> m;
+			for (size_t i = 0; i < f.size(); ++i)
+				m.push_back(new MinimizerCallback<_f, _filter>(f[i], minimizer_window, filter));
+			enum_seeds_parallel(m, p, shape_begin, shape_end, &no_filter);
+			return;
+		}
+		enum_seeds_filtered(f, p, shape_begin, shape_end, filter, Batched_filter<_filter>());
 	}
 
 	virtual ~Sequence_set()
 	{ }
 
+	// Only the window minimizers of the seeds are enumerated if this is greater than 1.
+	unsigned minimizer_window;
+
 private:
 
+	template <typename _f, typename _filter>
+	void enum_seeds_filtered(PtrVector<_f> &f, const vector<size_t> &p, size_t shape_begin, size_t shape_end, const _filter *filter, std::false_type) const
+	{
+		enum_seeds_parallel(f, p, shape_begin, shape_end, filter);
+	}
+
+	template <typename _f, typename _filter>
+	void enum_seeds_filtered(PtrVector<_f> &f, const vector<size_t> &p, size_t shape_begin, size_t shape_end, const _filter *filter, std::true_type) const
+	{
+		PtrVector<FilterBatchCallback<_f, _filter>> b;
+		for (size_t i = 0; i < f.size(); ++i)
+			b.push_back(new FilterBatchCallback<_f, _filter>(f[i], filter));
+		enum_seeds_parallel(b, p, shape_begin, shape_end, &no_filter);
+	}
+
+	template <typename _f, typename _filter>
+	void enum_seeds_parallel(PtrVector<_f> &f, const vector<size_t> &p, size_t shape_begin, size_t shape_end, const _filter *filter) const
+	{
+		std::vector<std::thread> threads;
+		for (unsigned i = 0; i < f.size(); ++i)
+			threads.emplace_back(enum_seeds_worker<_f, _filter>, &f[i], this, (unsigned)p[i], (unsigned)p[i + 1], std::make_pair(shape_begin, shape_end), filter);
+		for (auto &t : threads)
+			t.join();
+	}
+
 	template<typename _f, typename _filter>
 	void enum_seeds(_f *f, unsigned begin, unsigned end, pair<size_t, size_t> shape_range, const _filter *filter) const
 	{
@@ -164,6 +264,7 @@ private:
 			for (size_t shape_id = shape_range.first; shape_id < shape_range.second; ++shape_id) {
 				const Shape& sh = shapes[shape_id];
 				if (seq.length() < sh.length_) continue;
+				begin_sequence(*f, shape_id);
 				Seed_iterator it(buf, sh);
 				size_t j = 0;
 				while (it.good()) {
@@ -187,6 +288,7 @@ private:
 				const Shape& sh = shapes[shape_id];
 				if (seq.length() < sh.length_) continue;
 				const uint64_t shape_mask = sh.long_mask();
+				begin_sequence(*f, shape_id);
 				Hashed_seed_iterator<_b> it(seq, sh);
 				size_t j = 0;
 				while (it.good()) {
@@ -207,6 +309,7 @@ private:
 		for (unsigned i = begin; i < end; ++i) {
 			const sequence seq = (*this)[i];
 			if (seq.length() < _it::length()) continue;
+			begin_sequence(*f, 0);
 			_it it(seq);
 			size_t j = 0;
 			while (it.good()) {
@@ -274,14 +377,4 @@ private:
 
 };
 
-struct No_filter
-{
-	bool contains(uint64_t seed, uint64_t shape) const
-	{
-		return true;
-	}
-};
-
-extern No_filter no_filter;
-
 #endif /* SEQUENCE_SET_H_ */
\ No newline at end of file
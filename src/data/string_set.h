@@ -34,7 +34,8 @@ struct String_set
 	static const char DELIMITER = _pchar;
 
 	String_set():
-		data_ (PERIMETER_PADDING)
+		data_ (PERIMETER_PADDING),
+		view_ (nullptr)
 	{ limits_.push_back(PERIMETER_PADDING); }
 
 	void finish_reserve()
@@ -51,6 +52,18 @@ struct String_set
 		limits_.push_back(raw_len() + n + _padding);
 	}
 
+	// Use external memory laid out like the internal buffer (including the
+	// perimeter padding) instead of allocating it. Replaces finish_reserve().
+	void attach(_t *data)
+	{
+		data_.clear();
+		data_.shrink_to_fit();
+		view_ = data;
+	}
+
+	bool is_view() const
+	{ return view_ != nullptr; }
+
 	void push_back(const vector<_t> &v)
 	{
 		limits_.push_back(raw_len() + v.size() + _padding);
@@ -58,6 +71,13 @@ struct String_set
 		data_.insert(data_.end(), _padding, _pchar);
 	}
 
+	void push_back(const _t *begin, const _t *end)
+	{
+		limits_.push_back(raw_len() + (end - begin) + _padding);
+		data_.insert(data_.end(), begin, end);
+		data_.insert(data_.end(), _padding, _pchar);
+	}
+
 	void fill(size_t n, _t v)
 	{
 		limits_.push_back(raw_len() + n + _padding);
@@ -66,10 +86,10 @@ struct String_set
 	}
 
 	_t* ptr(size_t i)
-	{ return &data_[limits_[i]]; }
+	{ return base() + limits_[i]; }
 
 	const _t* ptr(size_t i) const
-	{ return &data_[limits_[i]]; }
+	{ return base() + limits_[i]; }
 
 	size_t check_idx(size_t i) const
 	{
@@ -97,10 +117,10 @@ struct String_set
 	{ return raw_len() - get_length() - PERIMETER_PADDING; }
 
 	_t* data(ptrdiff_t p = 0)
-	{ return &data_[p]; }
+	{ return base() + p; }
 
 	const _t* data(ptrdiff_t p = 0) const
-	{ return &data_[p]; }
+	{ return base() + p; }
 
 	size_t position(const _t* p) const
 	{ return p - data(); }
@@ -119,8 +139,15 @@ struct String_set
 
 private:
 
+	_t* base()
+	{ return view_ ? view_ : data_.data(); }
+
+	const _t* base() const
+	{ return view_ ? view_ : data_.data(); }
+
 	vector<_t> data_;
 	vector<size_t> limits_;
+	_t *view_;
 
 };
 
@@ -0,0 +1,84 @@
+/****
+DIAMOND protein aligner
+Copyright (C) 2013-2019 Benjamin Buchfink <buchfink@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+****/
+
+#include "title_store.h"
+
+using std::vector;
+using std::string;
+
+TitleStore::TitleStore(const DatabaseFile &db):
+	block_to_database_id_(nullptr)
+{
+	if (db.has_volumes())
+		for (const DatabaseFile::Volume &v : db.volumes_)
+			add_source(*v.db, v.first_seq);
+	else
+		add_source(db, 0);
+}
+
+void TitleStore::add_source(const DatabaseFile &db, uint64_t first_seq)
+{
+	sources_.emplace_back();
+	Source &s = sources_.back();
+	s.first_seq = first_seq;
+	s.title_index_offset = db.header2.title_index_offset;
+	s.mapped = db.mapped_.get();
+	if (!s.mapped)
+		s.file.reset(new InputFile(db.file_name));
+}
+
+bool TitleStore::available(const DatabaseFile &db)
+{
+	if (db.temporary || !db.separate_titles())
+		return false;
+	for (const DatabaseFile::Volume &v : db.volumes_)
+		if (!available(*v.db))
+			return false;
+	return true;
+}
+
+void TitleStore::init(const vector<unsigned> &block_to_database_id)
+{
+	block_to_database_id_ = &block_to_database_id;
+	titles_.clear();
+	titles_.resize(block_to_database_id.size());
+}
+
+const char* TitleStore::get(size_t block_id)
+{
+	const uint64_t database_id = (*block_to_database_id_)[block_id];
+	size_t i = sources_.size() - 1;
+	while (sources_[i].first_seq > database_id)
+		--i;
+	const Source &s = sources_[i];
+	const uint64_t index_pos = s.title_index_offset + sizeof(uint64_t) * (database_id - s.first_seq);
+	if (s.mapped)
+		return s.mapped->data(*(const uint64_t*)s.mapped->data(index_pos));
+
+	std::lock_guard<std::mutex> lock(mtx_);
+	if (!titles_[block_id]) {
+		uint64_t pos;
+		s.file->seek(index_pos);
+		s.file->read(pos);
+		titles_[block_id].reset(new string);
+		s.file->seek(pos);
+		if (!s.file->read_until(*titles_[block_id], '\0'))
+			throw std::runtime_error("Unexpected end of file.");
+	}
+	return titles_[block_id]->c_str();
+}
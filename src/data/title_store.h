@@ -0,0 +1,62 @@
+/****
+DIAMOND protein aligner
+Copyright (C) 2013-2019 Benjamin Buchfink <buchfink@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+****/
+
+#ifndef TITLE_STORE_H_
+#define TITLE_STORE_H_
+
+#include <stdint.h>
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include "reference.h"
+
+// Titles of the current reference block, which are read from the title section
+// of the database when they are first requested. The store uses file handles
+// of its own, so that reference blocks can be loaded at the same time.
+struct TitleStore
+{
+
+	TitleStore(const DatabaseFile &db);
+	// Sets the reference block that the block ids refer to and drops the cached titles.
+	void init(const std::vector<unsigned> &block_to_database_id);
+	const char* get(size_t block_id);
+
+	// Titles can be read on demand from databases of format version 4 or later
+	// that are not temporary.
+	static bool available(const DatabaseFile &db);
+
+private:
+
+	struct Source
+	{
+		uint64_t first_seq, title_index_offset;
+		const MappedFile *mapped;
+		std::unique_ptr<InputFile> file;
+	};
+
+	void add_source(const DatabaseFile &db, uint64_t first_seq);
+
+	std::vector<Source> sources_;
+	const std::vector<unsigned> *block_to_database_id_;
+	std::vector<std::unique_ptr<std::string>> titles_;
+	std::mutex mtx_;
+
+};
+
+#endif
@@ -562,13 +562,15 @@ namespace DP {
 	
 namespace Swipe {
 
-std::vector<int> swipe(const sequence &query, const sequence *subject_begin, const sequence *subject_end);
+// The subjects should be ordered by decreasing length, so that only short subjects remain
+// for the final columns where lanes start to run idle.
+std::vector<int> swipe(const sequence &query, const sequence *subject_begin, const sequence *subject_end, DpStat &stat);
 
 }
 
 namespace BandedSwipe {
 
-void swipe(const sequence &query, vector<DpTarget>::iterator target_begin, vector<DpTarget>::iterator target_end);
+void swipe(const sequence &query, vector<DpTarget>::iterator target_begin, vector<DpTarget>::iterator target_end, DpStat &stat);
 
 }
 
@@ -245,7 +245,7 @@ void traceback(const sequence &query, Strand strand, int dna_len, const Matrix<_
 }
 
 template<typename _sv>
-void swipe(const sequence &query, vector<DpTarget>::iterator subject_begin, vector<DpTarget>::iterator subject_end)
+void swipe(const sequence &query, vector<DpTarget>::iterator subject_begin, vector<DpTarget>::iterator subject_end, DpStat &stat)
 {
 	typedef typename ScoreTraits<_sv>::Score Score;
 
@@ -288,13 +288,18 @@ void swipe(const sequence &query, vector<DpTarget>::iterator subject_begin, vect
 			++it;
 		}
 
+		int live = 0;
 		for (int i = 0; i < targets.active.size();) {
 			int channel = targets.active[i];
+			if (targets.pos[channel] >= 0)
+				++live;
 			if (!targets.inc(channel))
 				targets.active.erase(i);
 			else
 				++i;
 		}
+		stat.gross_cells += (i1_ - i0_ + 1) * ScoreTraits<_sv>::CHANNELS;
+		stat.net_cells += (i1_ - i0_ + 1) * live;
 		++i0;
 		++i1;
 		++j;
@@ -311,7 +316,8 @@ void swipe(const sequence &query, vector<DpTarget>::iterator subject_begin, vect
 template<typename _sv>
 void swipe_targets(const sequence &query,
 	vector<DpTarget>::iterator begin,
-	vector<DpTarget>::iterator end)
+	vector<DpTarget>::iterator end,
+	DpStat &stat)
 {
 	for (vector<DpTarget>::iterator i = begin; i < end; i += ScoreTraits<_sv>::CHANNELS) {
 		/*if (!overflow_only || i->overflow) {
@@ -320,15 +326,15 @@ void swipe_targets(const sequence &query,
 			else
 				banded_3frame_swipe<_sv, Traceback>(query, strand, i, i + std::min(vector<DpTarget>::iterator::difference_type(ScoreTraits<_sv>::CHANNELS), end - i), stat, parallel);
 		}*/
-		swipe<_sv>(query, i, i + std::min(vector<DpTarget>::iterator::difference_type(ScoreTraits<_sv>::CHANNELS), end - i));
+		swipe<_sv>(query, i, i + std::min(vector<DpTarget>::iterator::difference_type(ScoreTraits<_sv>::CHANNELS), end - i), stat);
 	}
 }
 
-void swipe(const sequence &query, vector<DpTarget>::iterator target_begin, vector<DpTarget>::iterator target_end)
+void swipe(const sequence &query, vector<DpTarget>::iterator target_begin, vector<DpTarget>::iterator target_end, DpStat &stat)
 {
 #ifdef __SSE2__
 	std::stable_sort(target_begin, target_end);
-	swipe_targets<score_vector<int16_t>>(query, target_begin, target_end);
+	swipe_targets<score_vector<int16_t>>(query, target_begin, target_end, stat);
 #endif
 }
 
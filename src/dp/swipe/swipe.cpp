@@ -92,7 +92,7 @@ template<typename _sv> thread_local std::vector<_sv> DPMatrix<_sv>::score_;
 #ifdef __SSE2__
 
 template<typename _sv>
-vector<int> swipe(const sequence &query, const sequence *subject_begin, const sequence *subject_end)
+vector<int> swipe(const sequence &query, const sequence *subject_begin, const sequence *subject_end, DpStat &stat)
 {
 #ifdef SW_ENABLE_DEBUG
 	static int v[1024][1024];
@@ -106,6 +106,11 @@ vector<int> swipe(const sequence &query, const sequence *subject_begin, const se
 		vbias(score_matrix.bias());
 	_sv best;
 	SwipeProfile<_sv> profile;
+
+	size_t letters = 0, cols = 0;
+	for (const sequence *i = subject_begin; i < subject_end; ++i)
+		letters += i->length();
+
 	TargetBuffer<_sv::CHANNELS> targets(subject_begin, subject_end);
 	vector<int> out(targets.n_targets);
 
@@ -125,6 +130,7 @@ vector<int> swipe(const sequence &query, const sequence *subject_begin, const se
 			++it;
 		}
 		it.set_score(last);
+		++cols;
 		
 		for (int i = 0; i < targets.active.size();) {
 			int j = targets.active[i];
@@ -150,15 +156,17 @@ vector<int> swipe(const sequence &query, const sequence *subject_begin, const se
 	printf("\n");
 #endif
 
+	stat.gross_cells += cols * qlen * _sv::CHANNELS;
+	stat.net_cells += letters * qlen;
 	return out;
 }
 
 #endif
 
-vector<int> swipe(const sequence &query, const sequence *subject_begin, const sequence *subject_end)
+vector<int> swipe(const sequence &query, const sequence *subject_begin, const sequence *subject_end, DpStat &stat)
 {
 #ifdef __SSE2__
-	return swipe<score_vector<uint8_t>>(query, subject_begin, subject_end);
+	return swipe<score_vector<uint8_t>>(query, subject_begin, subject_end, stat);
 #endif
 }
 
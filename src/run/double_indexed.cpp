@@ -19,6 +19,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <iostream>
 #include <limits>
 #include <memory>
+#include <thread>
+#include <exception>
+#include <climits>
 #include "../data/reference.h"
 #include "../data/queries.h"
 #include "../basic/statistics.h"
@@ -33,8 +36,12 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "../basic/masking.h"
 #include "../data/ref_dictionary.h"
 #include "../data/metadata.h"
+#include "../data/seed_index.h"
+#include "../data/title_store.h"
 #include "../search/search.h"
+#include "../search/memory_model.h"
 #include "workflow.h"
+#include "serve.h"
 #include "../util/io/consumer.h"
 #include "../util/parallel/thread_pool.h"
 #include "../util/system/system.h"
@@ -43,51 +50,297 @@ using namespace std;
 
 namespace Workflow { namespace Search {
 
+// Loads the reference blocks. If the current block fits into the prefetch memory budget,
+// the next block is read in a background thread while the current one is processed.
+// The titles are not loaded with the blocks if they can be read on demand. The global
+// state that depends on the block is only set by the main thread when the block is handed over.
+struct RefBlockLoader
+{
+
+	RefBlockLoader(DatabaseFile &db_file, const vector<bool> *filter):
+		db_file_(db_file),
+		filter_(filter),
+		seqs_(nullptr),
+		ids_(nullptr),
+		loaded_(false),
+		partial_(false)
+	{
+		if (TitleStore::available(db_file) && config.sfilt.empty())
+			titles_.reset(new TitleStore(db_file));
+	}
+
+	~RefBlockLoader()
+	{
+		ref_ids::lazy_ = nullptr;
+		if (thread_.joinable()) {
+			thread_.join();
+			if (loaded_) {
+				delete seqs_;
+				delete ids_;
+			}
+		}
+	}
+
+	bool next(vector<unsigned> &block_to_database_id)
+	{
+		bool loaded;
+		if (thread_.joinable()) {
+			task_timer timer("Waiting for prefetched reference block");
+			thread_.join();
+			timer.finish();
+			if (error_)
+				std::rethrow_exception(error_);
+			loaded = loaded_;
+			loaded_ = false;
+			block_to_database_id.swap(block_to_database_id_);
+			ref_seqs::data_ = seqs_;
+			ref_ids::data_ = ids_;
+			blocked_processing = partial_;
+		}
+		else {
+			loaded = db_file_.load_seqs(block_to_database_id, (size_t)(config.chunk_size*1e9), &ref_seqs::data_, &ref_ids::data_, !titles_, filter_);
+			blocked_processing = db_file_.partial_block();
+		}
+		if (loaded)
+			ref_seqs::data_->print_stats();
+		if (loaded && titles_) {
+			ref_ids::data_ = nullptr;
+			titles_->init(block_to_database_id);
+			ref_ids::lazy_ = titles_.get();
+		}
+		if (loaded && prefetch_allowed()) {
+			log_stream << "Prefetching next reference block" << endl;
+			thread_ = thread(&RefBlockLoader::load, this);
+		}
+		return loaded;
+	}
+
+private:
+
+	bool prefetch_allowed() const
+	{
+		return ref_seqs::get().raw_len() + (ref_ids::data_ ? ref_ids::get().raw_len() : 0) <= (size_t)(config.prefetch_memory * 1e9);
+	}
+
+	void load()
+	{
+		try {
+			loaded_ = db_file_.load_seqs(block_to_database_id_, (size_t)(config.chunk_size*1e9), &seqs_, &ids_, !titles_, filter_, UINT_MAX);
+			partial_ = db_file_.partial_block();
+		}
+		catch (...) {
+			error_ = std::current_exception();
+		}
+	}
+
+	DatabaseFile &db_file_;
+	const vector<bool> *filter_;
+	Sequence_set *seqs_;
+	String_set<0> *ids_;
+	vector<unsigned> block_to_database_id_;
+	bool loaded_, partial_;
+	std::exception_ptr error_;
+	thread thread_;
+	unique_ptr<TitleStore> titles_;
+
+};
+
+// Loads the query chunks from the query file. If the current chunk fits into the
+// prefetch memory budget, the next chunk is read, masked, deduplicated and, once the search has
+// been set up, seed-histogrammed in a background thread while the current chunk
+// is processed.
+struct QueryChunkLoader
+{
+
+	QueryChunkLoader(TextInputFile &file, const Sequence_file_format &format):
+		file_(file),
+		format_(format),
+		seqs_(nullptr),
+		source_seqs_(nullptr),
+		ids_(nullptr),
+		qual_(nullptr),
+		dedup_(nullptr),
+		loaded_(false),
+		masked_(false)
+	{}
+
+	~QueryChunkLoader()
+	{
+		if (thread_.joinable()) {
+			thread_.join();
+			if (loaded_) {
+				delete seqs_;
+				delete source_seqs_;
+				delete ids_;
+				delete qual_;
+				delete dedup_;
+			}
+		}
+	}
+
+	// Makes the next chunk current. Returns false if the query file is exhausted.
+	// The chunk is masked and its deduplication is set in dedup if this was done in the background.
+	// The histogram is built by the caller, since the seed enumeration depends on the shapes and
+	// reduction that the search setup may change for each chunk.
+	bool next(bool &masked, QueryDedup *&dedup)
+	{
+		bool loaded;
+		masked = false;
+		dedup = nullptr;
+		if (thread_.joinable()) {
+			task_timer timer("Waiting for prefetched query chunk");
+			thread_.join();
+			timer.finish();
+			if (error_)
+				std::rethrow_exception(error_);
+			loaded = loaded_;
+			loaded_ = false;
+			query_seqs::data_ = seqs_;
+			query_source_seqs::data_ = source_seqs_;
+			query_ids::data_ = ids_;
+			query_qual = qual_;
+			masked = masked_;
+			dedup = dedup_;
+			dedup_ = nullptr;
+		}
+		else
+			loaded = load_seqs(file_, format_, &query_seqs::data_, query_ids::data_, &query_source_seqs::data_,
+				config.store_query_quality ? &query_qual : nullptr,
+				(size_t)(config.chunk_size * 1e9), config.qfilt) > 0;
+		if (loaded && prefetch_allowed()) {
+			log_stream << "Prefetching next query chunk" << endl;
+			thread_ = thread(&QueryChunkLoader::load, this);
+		}
+		return loaded;
+	}
+
+private:
+
+	bool prefetch_allowed() const
+	{
+		const size_t size = query_seqs::get().raw_len() + query_ids::get().raw_len()
+			+ (query_source_seqs::data_ ? query_source_seqs::get().raw_len() : 0)
+			+ (query_qual ? query_qual->raw_len() : 0);
+		return size <= (size_t)(config.query_prefetch_memory * 1e9);
+	}
+
+	// The loader runs while the search uses all cores, so it parses, translates and masks with fewer threads.
+	static size_t threads()
+	{
+		return std::max((size_t)config.threads_ / 4, (size_t)1);
+	}
+
+	void load()
+	{
+		try {
+			masked_ = false;
+			dedup_ = nullptr;
+			loaded_ = load_seqs(file_, format_, &seqs_, ids_, &source_seqs_, config.store_query_quality ? &qual_ : nullptr,
+				(size_t)(config.chunk_size * 1e9), config.qfilt, threads()) > 0;
+			if (!loaded_)
+				return;
+			if (config.masking == 1) {
+				mask_seqs(*seqs_, Masking::get(), true, threads());
+				masked_ = true;
+			}
+			if (config.query_dedup) {
+				dedup_ = new QueryDedup(*seqs_, source_seqs_);
+				dedup_->mask(*seqs_);
+			}
+		}
+		catch (...) {
+			error_ = std::current_exception();
+		}
+	}
+
+	TextInputFile &file_;
+	const Sequence_file_format &format_;
+	Sequence_set *seqs_, *source_seqs_;
+	String_set<0> *ids_, *qual_;
+	QueryDedup *dedup_;
+	bool loaded_, masked_;
+	std::exception_ptr error_;
+	thread thread_;
+
+};
+
 void run_ref_chunk(DatabaseFile &db_file,
 	Timer &total_timer,
 	unsigned query_chunk,
 	pair<size_t, size_t> query_len_bounds,
-	char *query_buffer,
+	char *&query_buffer,
+	size_t &query_entry_size,
 	Consumer &master_out,
 	PtrVector<TempFile> &tmp_file,
 	const Parameters &params,
 	const Metadata &metadata,
-	const vector<unsigned> &block_to_database_id)
+	const vector<unsigned> &block_to_database_id,
+	bool resident)
 {
 	log_stream << "Current RSS: " << getCurrentRSS() << ", Peak RSS: " << getPeakRSS() << endl;
 
 	task_timer timer;
-	if (config.masking == 1) {
+	if (config.masking == 1 && !resident) {
 		timer.go("Masking reference");
 		size_t n = mask_seqs(*ref_seqs::data_, Masking::get());
 		timer.finish();
 		log_stream << "Masked letters: " << n << endl;
 	}
 
-	timer.go("Building reference histograms");
-	if(config.algo==Config::query_indexed)
-		ref_hst = Partitioned_histogram(*ref_seqs::data_, false, query_seeds);
-	else if(query_seeds_hashed != 0)
-		ref_hst = Partitioned_histogram(*ref_seqs::data_, true, query_seeds_hashed);
-	else
-		ref_hst = Partitioned_histogram(*ref_seqs::data_, false, &no_filter);
+	ref_seqs::data_->minimizer_window = config.minimizer_window;
+	MinimizerStats::reset();
+
+	char *ref_buffer = nullptr;
+	unique_ptr<SeedBuffers> ref_buffers;
+	if (config.fused_seeds && !ref_seed_index)
+		ref_buffers.reset(new SeedBuffers(ref_seqs::get().letters(), config.threads_));
+	else if (!ref_seed_index) {
+		timer.go("Building reference histograms");
+		if (query_seeds_bloom != 0)
+			ref_hst = Partitioned_histogram(*ref_seqs::data_, false, query_seeds_bloom);
+		else if (config.algo == Config::query_indexed)
+			ref_hst = Partitioned_histogram(*ref_seqs::data_, false, query_seeds);
+		else if (query_seeds_hashed != 0)
+			ref_hst = Partitioned_histogram(*ref_seqs::data_, true, query_seeds_hashed);
+		else
+			ref_hst = Partitioned_histogram(*ref_seqs::data_, false, &no_filter);
+	}
 
 	ReferenceDictionary::get().init(safe_cast<unsigned>(ref_seqs::get().get_length()), block_to_database_id);
 
 	timer.go("Allocating buffers");
-	char *ref_buffer = SeedArray::alloc_buffer(ref_hst);
+	const bool compact = compact_seed_arrays();
+	const size_t entry_size = compact ? sizeof(CompactSeedArray::Entry) : sizeof(SeedArray::Entry);
+	if (entry_size > query_entry_size) {
+		delete[] query_buffer;
+		query_buffer = compact ? CompactSeedArray::alloc_buffer(query_hst) : SeedArray::alloc_buffer(query_hst);
+		query_entry_size = entry_size;
+	}
+	if (!ref_seed_index && !ref_buffers)
+		ref_buffer = compact ? CompactSeedArray::alloc_buffer(ref_hst) : SeedArray::alloc_buffer(ref_hst);
+	MemoryModel::update(query_seqs::get().letters(), ref_seqs::get().letters(), query_hst.max_chunk_size(), ref_seed_index || ref_buffers ? MemoryModel::seed_array_entries(config.chunk_size, config.lowmem) : ref_hst.max_chunk_size());
 
 	timer.go("Initializing temporary storage");
 	Trace_pt_buffer::instance = new Trace_pt_buffer(query_seqs::data_->get_length() / align_mode.query_contexts,
 		config.tmpdir,
 		config.query_bins);
+	if (query_dedup)
+		query_dedup->mask(*query_seqs::data_);
 	timer.finish();
 	
-	for (unsigned i = 0; i < shapes.count(); ++i)
-		search_shape(i, query_chunk, query_buffer, ref_buffer);
+	search_shapes(query_chunk, query_buffer, ref_buffer, ref_buffers.get());
+	if (ref_seqs::data_->minimizer_window > 1)
+		message_stream << "Reference minimizer window = " << ref_seqs::data_->minimizer_window << ", sampling density = " << MinimizerStats::density()
+			<< " (expected " << minimizer_density(ref_seqs::data_->minimizer_window) << ")" << endl;
+
+	if (query_dedup) {
+		timer.go("Restoring duplicate queries");
+		query_dedup->restore(*query_seqs::data_);
+	}
 
 	timer.go("Deallocating buffers");
 	delete[] ref_buffer;
+	ref_buffers.reset();
 
 	Consumer* out;
 	if (blocked_processing) {
@@ -105,9 +358,11 @@ void run_ref_chunk(DatabaseFile &db_file,
 	if (blocked_processing)
 		IntermediateRecord::finish_file(*out);
 
-	timer.go("Deallocating reference");
-	delete ref_seqs::data_;
-	delete ref_ids::data_;
+	if (!resident) {
+		timer.go("Deallocating reference");
+		delete ref_seqs::data_;
+		delete ref_ids::data_;
+	}
 	timer.finish();
 }
 
@@ -137,16 +392,30 @@ void run_query_chunk(DatabaseFile &db_file,
 			query_seeds = NULL;
 		}
 	}
-	else if (config.algo == Config::query_indexed) {
+	else if (config.algo == Config::query_indexed && !config.bloom_seeds) {
 		query_seeds = new Seed_set(query_seqs::get(), 2);
 		timer.finish();
 		log_stream << "Seed space coverage = " << query_seeds->coverage() << endl;
 	}
 	else
 		timer.finish();
-	if (query_chunk == 0)
+	if (query_chunk == 0) {
 		setup_search();
-	if (config.algo == Config::double_indexed && config.small_query) {
+		// The seed index holds all reference seeds, so it is not used with minimizer sampling.
+		if (config.minimizer_window <= 1) {
+			if (options.resident)
+				ref_seed_index = options.resident->seed_index.get();
+			else if (config.algo == Config::double_indexed && !config.small_query && !options.db_filter && !metadata.taxon_filter && !db_file.has_volumes())
+				ref_seed_index = SeedIndex::load(db_file);
+		}
+	}
+	if (config.bloom_seeds && (config.algo == Config::query_indexed || config.small_query)) {
+		timer.go("Building query seed filter");
+		delete query_seeds;
+		query_seeds = 0;
+		query_seeds_bloom = new Bloom_seed_set(query_seqs::get());
+	}
+	else if (config.algo == Config::double_indexed && config.small_query) {
 		timer.go("Building query seed hash set");
 		query_seeds_hashed = new Hashed_seed_set(query_seqs::get());
 	}
@@ -158,7 +427,10 @@ void run_query_chunk(DatabaseFile &db_file,
 	timer.finish();
 
 	timer.go("Allocating buffers");
-	char *query_buffer = SeedArray::alloc_buffer(query_hst);
+	// Allocated for the entry size of the first reference block and enlarged if a later
+	// block needs full entries.
+	char *query_buffer = nullptr;
+	size_t query_entry_size = 0;
 	PtrVector<TempFile> tmp_file;
 	query_aligned.clear();
 	query_aligned.insert(query_aligned.end(), query_ids::get().get_length(), false);
@@ -166,18 +438,27 @@ void run_query_chunk(DatabaseFile &db_file,
 	vector<unsigned> block_to_database_id;
 	timer.finish();
 	
-	for (current_ref_block = 0; db_file.load_seqs(block_to_database_id,
-		(size_t)(config.chunk_size*1e9),
-		&ref_seqs::data_,
-		&ref_ids::data_,
-		true,
-		options.db_filter ? options.db_filter : metadata.taxon_filter); ++current_ref_block)
-		run_ref_chunk(db_file, total_timer, query_chunk, query_len_bounds, query_buffer, master_out, tmp_file, params, metadata, block_to_database_id);
+	if (options.resident) {
+		blocked_processing = options.resident->blocks.size() > 1;
+		for (current_ref_block = 0; current_ref_block < options.resident->blocks.size(); ++current_ref_block) {
+			const ResidentReference::Block &block = options.resident->blocks[current_ref_block];
+			ref_seqs::data_ = block.seqs;
+			ref_ids::data_ = block.ids;
+			run_ref_chunk(db_file, total_timer, query_chunk, query_len_bounds, query_buffer, query_entry_size, master_out, tmp_file, params, metadata, block.block_to_database_id, true);
+		}
+	}
+	else {
+		RefBlockLoader loader(db_file, options.db_filter ? options.db_filter : metadata.taxon_filter);
+		for (current_ref_block = 0; loader.next(block_to_database_id); ++current_ref_block)
+			run_ref_chunk(db_file, total_timer, query_chunk, query_len_bounds, query_buffer, query_entry_size, master_out, tmp_file, params, metadata, block_to_database_id, false);
+	}
 
 	timer.go("Deallocating buffers");
 	delete[] query_buffer;
 	delete query_seeds;
 	query_seeds = 0;
+	delete query_seeds_bloom;
+	query_seeds_bloom = 0;
 
 	log_stream << "Current RSS: " << getCurrentRSS() << ", Peak RSS: " << getPeakRSS() << endl;
 
@@ -200,6 +481,8 @@ void run_query_chunk(DatabaseFile &db_file,
 	delete query_ids::data_;
 	delete query_source_seqs::data_;
 	delete query_qual;
+	delete query_dedup;
+	query_dedup = nullptr;
 	if (*output_format != Output_format::daa)
 		ReferenceDictionary::get().clear();
 }
@@ -207,12 +490,16 @@ void run_query_chunk(DatabaseFile &db_file,
 void master_thread(DatabaseFile *db_file, Timer &total_timer, Metadata &metadata, const Options &options)
 {
 	task_timer timer("Opening the input file", true);
-	unique_ptr<TextInputFile> query_file;
+	unique_ptr<TextInputFile> own_query_file;
+	TextInputFile *query_file = options.query_file;
 	const Sequence_file_format *format_n = nullptr;
 	if (!options.self) {
-		if (config.query_file.empty())
-			std::cerr << "Query file parameter (--query/-q) is missing. Input will be read from stdin." << endl;
-		query_file.reset(new TextInputFile(config.query_file));
+		if (!query_file) {
+			if (config.query_file.empty())
+				std::cerr << "Query file parameter (--query/-q) is missing. Input will be read from stdin." << endl;
+			own_query_file.reset(new TextInputFile(config.query_file));
+			query_file = own_query_file.get();
+		}
 		format_n = guess_format(*query_file);
 	}
 
@@ -230,8 +517,13 @@ void master_thread(DatabaseFile *db_file, Timer &total_timer, Metadata &metadata
 	timer.finish();
 
 	size_t query_file_offset = 0;
+	unique_ptr<QueryChunkLoader> query_loader;
+	if (!options.self)
+		query_loader.reset(new QueryChunkLoader(*query_file, *format_n));
 
 	for (;; ++current_query_chunk) {
+		bool masked = false;
+		QueryDedup *dedup = nullptr;
 		task_timer timer("Loading query sequences", true);
 
 		if (options.self) {
@@ -245,37 +537,46 @@ void master_thread(DatabaseFile *db_file, Timer &total_timer, Metadata &metadata
 				break;
 			query_file_offset = db_file->tell_seq();
 		}
-		else
-			if (!load_seqs(*query_file, *format_n, &query_seqs::data_, query_ids::data_, &query_source_seqs::data_,
-				config.store_query_quality ? &query_qual : nullptr,
-				(size_t)(config.chunk_size * 1e9), config.qfilt))
-				break;
+		else if (!query_loader->next(masked, dedup))
+			break;
 
 		timer.finish();
 		query_seqs::data_->print_stats();
 
-		if (current_query_chunk == 0 && *output_format != Output_format::daa)
+		if (current_query_chunk == 0 && options.header && *output_format != Output_format::daa)
 			output_format->print_header(*master_out, align_mode.mode, config.matrix.c_str(), score_matrix.gap_open(), score_matrix.gap_extend(), config.max_evalue, query_ids::get()[0].c_str(),
 				unsigned(align_mode.query_translated ? query_source_seqs::get()[0].length() : query_seqs::get()[0].length()));
 
-		if (config.masking == 1 && !options.self) {
+		if (config.masking == 1 && !options.self && !masked) {
 			timer.go("Masking queries");
 			mask_seqs(*query_seqs::data_, Masking::get());
 			timer.finish();
 		}
 
+		if (config.query_dedup && !options.self) {
+			if (!dedup) {
+				timer.go("Deduplicating queries");
+				dedup = new QueryDedup(*query_seqs::data_, query_source_seqs::data_);
+				dedup->mask(*query_seqs::data_);
+				timer.finish();
+			}
+			query_dedup = dedup;
+			log_stream << "Duplicate queries: " << dedup->count << endl;
+		}
+
 		run_query_chunk(*db_file, total_timer, current_query_chunk, *master_out, unaligned_file.get(), aligned_file.get(), metadata, options);
 	}
 
-	if (query_file) {
+	query_loader.reset();
+	if (own_query_file) {
 		timer.go("Closing the input file");
-		query_file->close();
+		own_query_file->close();
 	}
 
 	timer.go("Closing the output file");
 	if (*output_format == Output_format::daa)
 		finish_daa(*static_cast<OutputFile*>(master_out), *db_file);
-	else
+	else if (options.footer)
 		output_format->print_footer(*master_out);
 	master_out->finalize();
 	if (!options.consumer) delete master_out;
@@ -291,23 +592,23 @@ void master_thread(DatabaseFile *db_file, Timer &total_timer, Metadata &metadata
 	}
 
 	timer.go("Deallocating taxonomy");
-	metadata.free();
+	if (!options.resident) {
+		metadata.free();
+		delete ref_seed_index;
+	}
+	ref_seed_index = nullptr;
 
 	timer.finish();
 	log_stream << "Current RSS: " << getCurrentRSS() << ", Peak RSS: " << getPeakRSS() << endl;
+	MemoryModel::report();
 	message_stream << "Total time = " << total_timer.getElapsedTimeInSec() << "s" << endl;
 	statistics.print();
 }
 
-void run(const Options &options)
+void init(DatabaseFile &db_file, Metadata &metadata)
 {
-	Timer timer2;
-	timer2.start();
-
-	align_mode = Align_mode(Align_mode::from_command(config.command));
-
-	message_stream << "Temporary directory: " << TempFile::get_temp_dir() << endl;
-
+	task_timer timer;
+	MemoryModel::configure(db_file.ref_header.letters, db_file.has_statistics() ? &db_file.statistics : nullptr);
 	if (config.mode_very_sensitive) {
 		Config::set_option(config.chunk_size, 0.4);
 		Config::set_option(config.lowmem, 1u);
@@ -317,34 +618,34 @@ void run(const Options &options)
 		Config::set_option(config.lowmem, 4u);
 	}
 
-	task_timer timer("Opening the database", 1);
-	DatabaseFile *db_file = options.db ? options.db : DatabaseFile::auto_create_from_fasta();
-	timer.finish();
+	init_output(db_file.has_taxon_id_lists(), db_file.has_taxon_nodes(), db_file.has_taxon_scientific_names());
 
-	init_output(db_file->has_taxon_id_lists(), db_file->has_taxon_nodes(), db_file->has_taxon_scientific_names());
+	if (!config.volumes.empty())
+		db_file.select_volumes(config.volumes);
 
 	verbose_stream << "Reference = " << config.database << endl;
-	verbose_stream << "Sequences = " << db_file->ref_header.sequences << endl;
-	verbose_stream << "Letters = " << db_file->ref_header.letters << endl;
+	verbose_stream << "Sequences = " << db_file.ref_header.sequences << endl;
+	verbose_stream << "Letters = " << db_file.ref_header.letters << endl;
+	if (db_file.has_statistics())
+		verbose_stream << "Sequence length = " << db_file.statistics.min_len << '-' << db_file.statistics.max_len << endl;
 	verbose_stream << "Block size = " << (size_t)(config.chunk_size * 1e9) << endl;
-	Config::set_option(config.db_size, (uint64_t)db_file->ref_header.letters);
-	score_matrix.set_db_letters(db_file->ref_header.letters);
+	Config::set_option(config.db_size, (uint64_t)db_file.ref_header.letters);
+	score_matrix.set_db_letters(db_file.ref_header.letters);
 
-	set_max_open_files(config.query_bins * config.threads_ + unsigned(db_file->ref_header.letters / (size_t)(config.chunk_size * 1e9)) + 16);
+	set_max_open_files(config.query_bins * config.threads_ + unsigned(db_file.ref_header.letters / (size_t)(config.chunk_size * 1e9)) + 16);
 
-	Metadata metadata;
 	if (output_format->needs_taxon_id_lists || !config.taxonlist.empty()) {
-		if (!config.taxonlist.empty() && db_file->header2.taxon_array_offset == 0)
+		if (!config.taxonlist.empty() && db_file.header2.taxon_array_offset == 0)
 			throw std::runtime_error("--taxonlist option requires taxonomy mapping built into the database.");
 		timer.go("Loading taxonomy mapping");
-		metadata.taxon_list = new TaxonList(db_file->seek(db_file->header2.taxon_array_offset), db_file->ref_header.sequences, db_file->header2.taxon_array_size);
+		metadata.taxon_list = new TaxonList(db_file.seek(db_file.header2.taxon_array_offset), db_file.ref_header.sequences, db_file.header2.taxon_array_size);
 		timer.finish();
 	}
 	if (output_format->needs_taxon_nodes || !config.taxonlist.empty()) {
-		if (!config.taxonlist.empty() && db_file->header2.taxon_nodes_offset == 0)
+		if (!config.taxonlist.empty() && db_file.header2.taxon_nodes_offset == 0)
 			throw std::runtime_error("--taxonlist option requires taxonomy nodes built into the database.");
 		timer.go("Loading taxonomy nodes");
-		metadata.taxon_nodes = new TaxonomyNodes(db_file->seek(db_file->header2.taxon_nodes_offset));
+		metadata.taxon_nodes = new TaxonomyNodes(db_file.seek(db_file.header2.taxon_nodes_offset));
 		if (!config.taxonlist.empty()) {
 			timer.go("Building taxonomy filter");
 			metadata.taxon_filter = new TaxonomyFilter(config.taxonlist, config.taxon_exclude, *metadata.taxon_list, *metadata.taxon_nodes);
@@ -354,10 +655,30 @@ void run(const Options &options)
 	if (output_format->needs_taxon_scientific_names) {
 		timer.go("Loading taxonomy names");
 		metadata.taxonomy_scientific_names = new vector<string>;
-		db_file->seek(db_file->header2.taxon_names_offset);
-		*db_file >> *metadata.taxonomy_scientific_names;
+		db_file.seek(db_file.header2.taxon_names_offset);
+		db_file >> *metadata.taxonomy_scientific_names;
 		timer.finish();
 	}
+}
+
+void run(const Options &options)
+{
+	Timer timer2;
+	timer2.start();
+
+	align_mode = Align_mode(Align_mode::from_command(config.command));
+
+	message_stream << "Temporary directory: " << TempFile::get_temp_dir() << endl;
+
+	task_timer timer("Opening the database", 1);
+	DatabaseFile *db_file = options.db ? options.db : DatabaseFile::auto_create_from_fasta();
+	timer.finish();
+
+	Metadata metadata;
+	if (options.resident)
+		metadata = options.resident->metadata;
+	else
+		init(*db_file, metadata);
 
 	master_thread(db_file, timer2, metadata, options);
 }
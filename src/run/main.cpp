@@ -20,6 +20,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "../basic/config.h"
 #include "tools.h"
 #include "../data/reference.h"
+#include "../data/seed_index.h"
 #include "workflow.h"
 #ifdef EXTRA
 #include "../extra/compare.h"
@@ -65,6 +66,8 @@ int main(int ac, const char* av[])
 			break;
 		case Config::makedb:
 			make_db();
+			if (config.seed_index)
+				SeedIndex::build(config.database);
 			break;
 		case Config::blastp:
 		case Config::blastx:
@@ -112,6 +115,9 @@ int main(int ac, const char* av[])
 		case Config::cluster:
 			Workflow::Cluster::run();
 			break;
+		case Config::serve:
+			Workflow::Serve::run();
+			break;
 		case Config::translate:
 			translate();
 			break;
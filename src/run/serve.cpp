@@ -0,0 +1,533 @@
+/****
+DIAMOND protein aligner
+Copyright (C) 2013-2019 Benjamin Buchfink <buchfink@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+****/
+
+#include <stdexcept>
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <string.h>
+#ifndef _MSC_VER
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#endif
+#include "serve.h"
+#include "workflow.h"
+#include "../basic/config.h"
+#include "../basic/masking.h"
+#include "../basic/statistics.h"
+#include "../basic/value.h"
+#include "../search/align_range.h"
+#include "../util/io/consumer.h"
+#include "../util/io/text_input_file.h"
+#include "../util/log_stream.h"
+#include "../output/output_format.h"
+
+using std::string;
+using std::vector;
+using std::endl;
+using std::unique_ptr;
+using std::thread;
+using std::mutex;
+using std::unique_lock;
+using std::condition_variable;
+typedef std::chrono::steady_clock Clock;
+
+ResidentReference::ResidentReference(DatabaseFile &db)
+{
+	Workflow::Search::init(db, metadata);
+	setup_search_cont();
+	setup_search();
+
+	vector<const Sequence_set*> seqs;
+	Block block;
+	task_timer timer;
+	db.rewind();
+	while (db.load_seqs(block.block_to_database_id, (size_t)(config.chunk_size * 1e9), &block.seqs, &block.ids, true)) {
+		block.seqs->print_stats();
+		if (config.masking == 1) {
+			timer.go("Masking reference");
+			mask_seqs(*block.seqs, Masking::get());
+			timer.finish();
+		}
+		seqs.push_back(block.seqs);
+		blocks.push_back(block);
+		block.block_to_database_id.clear();
+	}
+	seed_index.reset(new SeedIndex(seqs));
+}
+
+ResidentReference::~ResidentReference()
+{
+	metadata.free();
+	for (Block &b : blocks) {
+		delete b.seqs;
+		delete b.ids;
+	}
+}
+
+namespace Workflow { namespace Serve {
+
+#ifndef _MSC_VER
+
+// Writes the results of a request to a connected socket or to the response FIFO.
+// The FIFO is opened on the first write, so that a client may send the whole
+// request before opening it for reading. The request fails if the client does not
+// open the FIFO within FIFO_OPEN_TIMEOUT seconds. Since the writes come from the
+// threads of the search, errors are recorded and the remaining output is discarded.
+struct ResponseWriter : public Consumer
+{
+
+	enum { FIFO_OPEN_TIMEOUT = 60 };
+
+	ResponseWriter(int fd):
+		fd_(fd),
+		fifo_(false)
+	{}
+
+	ResponseWriter(const string &fifo):
+		fd_(-1),
+		fifo_(true),
+		file_name_(fifo)
+	{}
+
+	virtual void consume(const char *ptr, size_t n) override
+	{
+		if (!open())
+			return;
+		while (n > 0) {
+			const ssize_t written = write(fd_, ptr, n);
+			if (written < 0) {
+				if (errno == EINTR)
+					continue;
+				error_ = string("Error writing response: ") + strerror(errno);
+				return;
+			}
+			ptr += written;
+			n -= written;
+		}
+	}
+
+	virtual void finalize() override
+	{
+		open();
+	}
+
+	const string& error() const
+	{
+		return error_;
+	}
+
+	virtual ~ResponseWriter()
+	{
+		if (fifo_ && fd_ >= 0)
+			close(fd_);
+	}
+
+private:
+
+	// Opening a FIFO for writing without a reader fails with ENXIO in non-blocking mode, so
+	// the open is retried until the client has opened the FIFO or the timeout expires.
+	bool open()
+	{
+		if (!error_.empty())
+			return false;
+		if (fd_ >= 0)
+			return true;
+		const Clock::time_point deadline = Clock::now() + std::chrono::seconds(FIFO_OPEN_TIMEOUT);
+		while ((fd_ = ::open(file_name_.c_str(), O_WRONLY | O_NONBLOCK)) < 0) {
+			if (errno != ENXIO && errno != EINTR) {
+				error_ = "Error opening response FIFO " + file_name_ + ": " + strerror(errno);
+				return false;
+			}
+			if (Clock::now() >= deadline) {
+				error_ = "Client did not open the response FIFO " + file_name_;
+				return false;
+			}
+			poll(nullptr, 0, 10);
+		}
+		fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) & ~O_NONBLOCK);
+		return true;
+	}
+
+	int fd_;
+	const bool fifo_;
+	const string file_name_;
+	string error_;
+
+};
+
+// Searches the queries of the input. Errors are reported to the client, so that
+// the server keeps running.
+static void serve_request(DatabaseFile &db, const ResidentReference &ref, TextInputFile &in, ResponseWriter &out, bool header = true, bool footer = true)
+{
+	statistics.reset();
+	Search::Options options;
+	options.db = &db;
+	options.consumer = &out;
+	options.query_file = &in;
+	options.resident = &ref;
+	options.header = header;
+	options.footer = footer;
+	try {
+		Search::run(options);
+	}
+	catch (const std::exception &e) {
+		std::cerr << "Error: " << e.what() << endl;
+		try {
+			const string msg = string("Error: ") + e.what() + '\n';
+			out.consume(msg.data(), msg.length());
+		}
+		catch (const std::exception&) {
+		}
+	}
+	if (!out.error().empty())
+		std::cerr << "Error: " << out.error() << endl;
+	in.close();
+}
+
+static void serve_socket(DatabaseFile &db, const ResidentReference &ref)
+{
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (config.serve_socket.length() >= sizeof(addr.sun_path))
+		throw std::runtime_error("Socket path is too long: " + config.serve_socket);
+	strcpy(addr.sun_path, config.serve_socket.c_str());
+
+	const int s = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (s < 0) {
+		perror(0);
+		throw std::runtime_error("Error creating socket.");
+	}
+	unlink(config.serve_socket.c_str());
+	if (bind(s, (const sockaddr*)&addr, sizeof(addr)) != 0 || listen(s, 16) != 0) {
+		perror(0);
+		throw std::runtime_error("Error binding socket " + config.serve_socket);
+	}
+	message_stream << "Accepting requests on socket " << config.serve_socket << endl;
+
+	// Each connection is served by a child process, which shares the resident reference with
+	// the server through copy-on-write pages, since the search keeps its state in globals.
+	unsigned running = 0;
+	while (true) {
+		pid_t child;
+		while (running > 0 && (child = waitpid(-1, nullptr, running >= config.serve_connections ? 0 : WNOHANG)) != 0) {
+			if (child > 0)
+				--running;
+			else if (errno != EINTR)
+				running = 0;
+		}
+		const int c = accept(s, nullptr, nullptr);
+		if (c < 0) {
+			if (errno == EINTR)
+				continue;
+			perror(0);
+			throw std::runtime_error("Error accepting connection.");
+		}
+		const pid_t pid = fork();
+		if (pid < 0) {
+			perror(0);
+			close(c);
+			continue;
+		}
+		if (pid > 0) {
+			close(c);
+			++running;
+			continue;
+		}
+		close(s);
+		// The request is read from a duplicate of the descriptor, which is closed with the input file.
+		FILE *f = fdopen(dup(c), "rb");
+		if (f == nullptr)
+			perror(0);
+		else {
+			TextInputFile in(config.serve_socket, f);
+			ResponseWriter out(c);
+			serve_request(db, ref, in, out);
+		}
+		close(c);
+		std::cout.flush();
+		std::cerr.flush();
+		_exit(0);
+	}
+}
+
+static void make_fifo(const string &file_name)
+{
+	struct stat buf;
+	if (stat(file_name.c_str(), &buf) == 0) {
+		if (!S_ISFIFO(buf.st_mode))
+			throw std::runtime_error("File exists and is not a FIFO: " + file_name);
+		return;
+	}
+	if (mkfifo(file_name.c_str(), 0600) != 0) {
+		perror(0);
+		throw std::runtime_error("Error creating FIFO " + file_name);
+	}
+}
+
+static void serve_fifo(DatabaseFile &db, const ResidentReference &ref)
+{
+	const string in_file = config.serve_fifo + ".in", out_file = config.serve_fifo + ".out";
+	make_fifo(in_file);
+	make_fifo(out_file);
+	message_stream << "Accepting requests on FIFO " << in_file << ", writing results to " << out_file << endl;
+
+	while (true) {
+		TextInputFile in(in_file);
+		ResponseWriter out(out_file);
+		serve_request(db, ref, in, out);
+	}
+}
+
+// Collects the query records read from the stream input into micro-batches. The input
+// is read with plain reads, so that records become available as soon as they arrive.
+// A batch is passed on once its oldest record has waited for config.max_latency
+// seconds, or when it reaches the block size. Batches grow while the previous one is
+// searched, so that the throughput approaches that of the regular search under load.
+// A FASTA record is only complete once the next record starts or the input ends, since
+// its sequence may continue on further lines at any time.
+struct StreamBatcher
+{
+
+	StreamBatcher(int fd):
+		fd_(fd),
+		max_letters_((size_t)(config.chunk_size * 1e9)),
+		latency_(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(config.max_latency))),
+		format_known_(false),
+		fastq_(false),
+		partial_lines_(0),
+		partial_letters_(0),
+		letters_(0),
+		eof_(false)
+	{
+		if (pipe(stop_) != 0)
+			throw std::runtime_error(string("Error creating pipe: ") + strerror(errno));
+		thread_ = thread(&StreamBatcher::read, this);
+	}
+
+	~StreamBatcher()
+	{
+		// The reader may still be waiting for input after an error, so it is woken up through the pipe.
+		const char c = 0;
+		while (write(stop_[1], &c, 1) < 0 && errno == EINTR);
+		thread_.join();
+		close(stop_[0]);
+		close(stop_[1]);
+	}
+
+	// Returns the next batch, or false if the input is exhausted.
+	bool next(string &batch)
+	{
+		unique_lock<mutex> lock(mtx_);
+		while (true) {
+			if (error_)
+				std::rethrow_exception(error_);
+			const Clock::time_point now = Clock::now();
+			if (!complete_.empty() && (eof_ || letters_ >= max_letters_ || now >= complete_start_ + latency_)) {
+				batch.swap(complete_);
+				complete_.clear();
+				letters_ = 0;
+				return true;
+			}
+			if (eof_)
+				return false;
+			if (!complete_.empty())
+				cv_.wait_until(lock, complete_start_ + latency_);
+			else
+				cv_.wait(lock);
+		}
+	}
+
+private:
+
+	void read()
+	{
+		vector<char> buf(65536);
+		string line;
+		try {
+			while (true) {
+				pollfd fds[] = { { fd_, POLLIN, 0 }, { stop_[0], POLLIN, 0 } };
+				if (poll(fds, 2, -1) < 0) {
+					if (errno == EINTR)
+						continue;
+					throw std::runtime_error(string("Error polling query input: ") + strerror(errno));
+				}
+				if (fds[1].revents != 0)
+					return;
+				const ssize_t n = ::read(fd_, buf.data(), buf.size());
+				if (n < 0) {
+					if (errno == EINTR)
+						continue;
+					throw std::runtime_error(string("Error reading query input: ") + strerror(errno));
+				}
+				if (n == 0)
+					break;
+				unique_lock<mutex> lock(mtx_);
+				const char *p = buf.data(), *end = p + n;
+				while (p < end) {
+					const char *q = (const char*)memchr(p, '\n', end - p);
+					if (q == nullptr) {
+						line.append(p, end);
+						break;
+					}
+					line.append(p, q + 1);
+					add_line(line);
+					line.clear();
+					p = q + 1;
+				}
+				lock.unlock();
+				cv_.notify_one();
+			}
+			unique_lock<mutex> lock(mtx_);
+			if (!line.empty())
+				add_line(line + '\n');
+			if (!partial_.empty())
+				complete_partial();
+			eof_ = true;
+		}
+		catch (...) {
+			unique_lock<mutex> lock(mtx_);
+			error_ = std::current_exception();
+			eof_ = true;
+		}
+		cv_.notify_one();
+	}
+
+	void add_line(const string &line)
+	{
+		if (line.length() <= 1 && partial_.empty())
+			return;
+		if (!format_known_) {
+			fastq_ = line[0] == '@';
+			format_known_ = true;
+		}
+		if (!fastq_ && line[0] == '>' && !partial_.empty())
+			complete_partial();
+		if (partial_.empty())
+			partial_start_ = Clock::now();
+		partial_ += line;
+		++partial_lines_;
+		if (fastq_ ? partial_lines_ == 2 : line[0] != '>')
+			partial_letters_ += line.length() - 1;
+		if (fastq_ && partial_lines_ == 4)
+			complete_partial();
+	}
+
+	void complete_partial()
+	{
+		if (complete_.empty())
+			complete_start_ = partial_start_;
+		complete_ += partial_;
+		letters_ += partial_letters_;
+		partial_.clear();
+		partial_lines_ = 0;
+		partial_letters_ = 0;
+	}
+
+	const int fd_;
+	const size_t max_letters_;
+	const Clock::duration latency_;
+	bool format_known_, fastq_;
+	string complete_, partial_;
+	size_t partial_lines_, partial_letters_, letters_;
+	Clock::time_point complete_start_, partial_start_;
+	int stop_[2];
+	bool eof_;
+	std::exception_ptr error_;
+	mutex mtx_;
+	condition_variable cv_;
+	thread thread_;
+
+};
+
+static void serve_stream(DatabaseFile &db, const ResidentReference &ref)
+{
+	const int in_fd = config.query_file.empty() ? STDIN_FILENO : ::open(config.query_file.c_str(), O_RDONLY);
+	if (in_fd < 0)
+		throw std::runtime_error("Error opening query file " + config.query_file);
+	const int out_fd = config.output_file.empty() ? STDOUT_FILENO : ::open(config.output_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (out_fd < 0)
+		throw std::runtime_error("Error opening output file " + config.output_file);
+	if (config.query_file.empty())
+		message_stream << "Reading queries from stdin" << endl;
+
+	ResponseWriter out(out_fd);
+	string batch;
+	size_t n = 0;
+	{
+		StreamBatcher batcher(in_fd);
+		while (batcher.next(batch)) {
+			FILE *f = fmemopen((void*)batch.data(), batch.length(), "rb");
+			if (f == nullptr)
+				throw std::runtime_error("Error opening query batch.");
+			TextInputFile in("stdin", f);
+			serve_request(db, ref, in, out, n == 0, false);
+			++n;
+		}
+	}
+	if (n > 0)
+		output_format->print_footer(out);
+	log_stream << "Query batches = " << n << endl;
+	if (in_fd != STDIN_FILENO)
+		close(in_fd);
+	if (out_fd != STDOUT_FILENO)
+		close(out_fd);
+}
+
+#endif
+
+void run()
+{
+#ifdef _MSC_VER
+	throw std::runtime_error("The serve command is not supported on Windows.");
+#else
+	config.command = config.serve_mode == "blastx" ? Config::blastx : Config::blastp;
+	config.algo = Config::double_indexed;
+	align_mode = Align_mode(Align_mode::from_command(config.command));
+	signal(SIGPIPE, SIG_IGN);
+
+	task_timer timer("Opening the database");
+	unique_ptr<DatabaseFile> db(DatabaseFile::auto_create_from_fasta());
+	timer.finish();
+
+	const ResidentReference ref(*db);
+	message_stream << "Resident reference blocks: " << ref.blocks.size() << endl;
+
+	if (!config.serve_socket.empty())
+		serve_socket(*db, ref);
+	else if (!config.serve_fifo.empty())
+		serve_fifo(*db, ref);
+	else
+		serve_stream(*db, ref);
+#endif
+}
+
+}}
@@ -0,0 +1,52 @@
+/****
+DIAMOND protein aligner
+Copyright (C) 2013-2019 Benjamin Buchfink <buchfink@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+****/
+
+#ifndef SERVE_H_
+#define SERVE_H_
+
+#include <vector>
+#include <memory>
+#include "../data/reference.h"
+#include "../data/seed_index.h"
+#include "../data/metadata.h"
+
+// Reference state of the serve command, which is set up once and used by every
+// request: the output settings and taxonomy data, and the reference blocks, which
+// are loaded and masked once and searched together with a seed index built in memory.
+// The search only reads this state, so that it is shared with the processes that serve
+// the socket connections.
+struct ResidentReference
+{
+
+	struct Block
+	{
+		Sequence_set *seqs;
+		String_set<0> *ids;
+		std::vector<unsigned> block_to_database_id;
+	};
+
+	ResidentReference(DatabaseFile &db);
+	~ResidentReference();
+
+	Metadata metadata;
+	std::vector<Block> blocks;
+	std::unique_ptr<SeedIndex> seed_index;
+
+};
+
+#endif
@@ -170,9 +170,21 @@ void test_io()
 
 	DatabaseFile db(config.database);
 	vector<unsigned> v;
-	db.load_seqs(v, std::numeric_limits<size_t>::max(), &ref_seqs::data_, &ref_ids::data_);
+	const size_t block_letters = config.chunk_size == 0.0 ? std::numeric_limits<size_t>::max() : (size_t)(config.chunk_size * 1e9);
+	size_t total = 0, blocks = 0;
+	while (db.load_seqs(v, block_letters, &ref_seqs::data_, &ref_ids::data_)) {
+		const bool mapped = ref_seqs::get().is_view() && ref_ids::get().is_view();
+		cout << "Block " << blocks << ": " << ref_seqs::get().get_length() << " sequences, " << ref_seqs::get().letters() << " letters, " << (mapped ? "mapped" : "copied") << endl;
+		if (config.mmap_db && !db.packed() && !mapped)
+			throw std::runtime_error("Reference block was not mapped in place.");
+		total += ref_seqs::get().raw_len() + ref_ids::get().raw_len();
+		++blocks;
+		delete ref_seqs::data_;
+		delete ref_ids::data_;
+		ref_seqs::data_ = nullptr;
+		ref_ids::data_ = nullptr;
+	}
 
-	size_t total = ref_seqs::get().raw_len() + ref_ids::get().raw_len();
 	cout << "MBytes/sec = " << total / 1e6 / t.getElapsedTime() << endl;
 	cout << "Time = " << t.getElapsedTime() << "s" << endl;
 }
@@ -5,6 +5,9 @@
 
 struct DatabaseFile;
 struct Consumer;
+struct TextInputFile;
+struct ResidentReference;
+struct Metadata;
 
 namespace Workflow { 
 
@@ -15,14 +18,28 @@ struct Options {
 		self(false),
 		db(nullptr),
 		consumer(nullptr),
-		db_filter(nullptr)
+		db_filter(nullptr),
+		query_file(nullptr),
+		resident(nullptr),
+		header(true),
+		footer(true)
 	{}
 	bool self;
 	DatabaseFile *db;
 	Consumer *consumer;
 	const std::vector<bool> *db_filter;
+	// Query input to use instead of the query file.
+	TextInputFile *query_file;
+	// Reference blocks kept in memory, which are searched instead of the blocks of the database.
+	// The output settings and taxonomy data of the reference are kept as well.
+	const ResidentReference *resident;
+	// Print the header and the footer of the output format. Batches of a stream
+	// leave them out except for the header of the first batch.
+	bool header, footer;
 };
 
+// Sets up the output and loads the taxonomy data of the database.
+void init(DatabaseFile &db_file, Metadata &metadata);
 void run(const Options &options);
 
 }
@@ -33,6 +50,12 @@ void run();
 
 }
 
+namespace Serve {
+
+void run();
+
+}
+
 }
 
 #endif
\ No newline at end of file
@@ -118,7 +118,9 @@ struct Seed_filter
 		out(out),
 		sid(sid)
 	{}
-	void run(const Packed_loc *q, size_t nq, const Packed_loc *s, size_t ns);
+	// Positions are stored as Packed_loc or, for compact seed arrays, as uint32_t.
+	template<typename _pos>
+	void run(const _pos *q, size_t nq, const _pos *s, size_t ns);
 	void tiled_search(vector<Finger_print>::const_iterator q,
 		vector<Finger_print>::const_iterator q_end,
 		vector<Finger_print>::const_iterator s,
@@ -133,8 +135,9 @@ struct Seed_filter
 	const unsigned sid;
 };
 
-void stage2_search(const Packed_loc *q,
-	const Packed_loc *s,
+template<typename _pos>
+void stage2_search(const _pos *q,
+	const _pos *s,
 	const vector<Stage1_hit> &hits,
 	Statistics &stats,
 	Trace_pt_buffer::Iterator &out,
@@ -0,0 +1,179 @@
+/****
+DIAMOND protein aligner
+Copyright (C) 2013-2019 Benjamin Buchfink <buchfink@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+****/
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+#include "memory_model.h"
+#include "../basic/config.h"
+#include "../basic/value.h"
+#include "../data/seed_array.h"
+#include "../data/minimizer.h"
+#include "../data/reference.h"
+#include "../util/log_stream.h"
+#include "../util/system/system.h"
+
+using std::endl;
+
+namespace MemoryModel {
+
+// Block sizes are chosen in steps of 10 million letters.
+static const double MIN_BLOCK_SIZE = 0.01;
+static const unsigned MAX_INDEX_CHUNKS = 16;
+// Bytes per letter of the blocks including sequence limits and titles. Translated
+// query blocks also hold the source sequences.
+static const double REF_BYTES_PER_LETTER = 1.5, QUERY_BYTES_PER_LETTER = 1.5, QUERY_SOURCE_BYTES_PER_LETTER = 0.5;
+// Headroom for uneven seed partitions.
+static const double SEED_PARTITION_SKEW = 1.1;
+static const double FIXED_BYTES = 5e8, THREAD_BYTES = 3.2e7;
+// Headroom for the sequence padding in the positions of a block.
+static const double COMPACT_LETTER_FACTOR = 1.1;
+// Given the mean sequence length of the database, the reference blocks are estimated as
+// one byte per letter for the sequences, the titles and the per-sequence bytes for the
+// limits of sequences and titles and the padding.
+static const double REF_TITLE_BYTES_PER_LETTER = 0.45, SEQUENCE_BYTES = 2 * sizeof(size_t) + 1;
+
+static double predicted = 0.0, block_peak = 0.0, ref_bytes_per_letter = REF_BYTES_PER_LETTER, compact_letter_factor = COMPACT_LETTER_FACTOR;
+
+size_t trace_point_bytes(double block_size, unsigned index_chunks)
+{
+	return (size_t)std::min(block_size * 1e9 * 9 * 2 / index_chunks, 2e9);
+}
+
+size_t seed_array_entries(double block_size, unsigned index_chunks)
+{
+	return (size_t)(block_size * 1e9 / index_chunks * SEED_PARTITION_SKEW);
+}
+
+double predict(double block_size, unsigned index_chunks, size_t query_letters, size_t ref_letters, size_t query_seed_entries, size_t ref_seed_entries)
+{
+	// Compact seed arrays are used if the positions of both blocks fit into 32 bits.
+	const bool compact = std::max(query_letters, ref_letters) * compact_letter_factor <= UINT32_MAX;
+	const double query_block = query_letters * (QUERY_BYTES_PER_LETTER + (align_mode.query_translated ? QUERY_SOURCE_BYTES_PER_LETTER : 0.0)),
+		ref_block = ref_letters * ref_bytes_per_letter,
+		prefetch = std::min(config.prefetch_memory * 1e9, ref_block),
+		// The next query chunk is loaded in the background if the current one fits into the query prefetch memory.
+		query_prefetch = query_block <= config.query_prefetch_memory * 1e9 ? query_block : 0.0,
+		entry_size = (double)(compact ? sizeof(CompactSeedArray::Entry) : sizeof(SeedArray::Entry)),
+		query_seed_array = entry_size * query_seed_entries,
+		ref_seed_array = config.fused_seeds ? (double)SeedBuffers::bytes(ref_seed_entries, (size_t)entry_size, ref_letters, config.threads_, index_chunks) : entry_size * ref_seed_entries,
+		index_prefetch = query_seed_array + ref_seed_array <= config.index_prefetch_memory * 1e9 ? query_seed_array + ref_seed_array : 0.0;
+	// The reference seed array is freed before the trace points are loaded, while the query seed array is kept.
+	return FIXED_BYTES + THREAD_BYTES * config.threads_ + query_block + query_prefetch + ref_block + prefetch + query_seed_array + index_prefetch
+		+ std::max(ref_seed_array, (double)trace_point_bytes(block_size, index_chunks));
+}
+
+// Prediction for full query and reference blocks, with the reference seeds reduced by the
+// expected density of the minimizer sampling.
+static double predict(double block_size, unsigned index_chunks)
+{
+	const size_t letters = (size_t)(block_size * 1e9), n = seed_array_entries(block_size, index_chunks);
+	return predict(block_size, index_chunks, letters, letters, n, (size_t)(n * minimizer_density(config.minimizer_window)));
+}
+
+static bool fits(double block_size, unsigned index_chunks, double limit)
+{
+	return predict(block_size, index_chunks) <= limit;
+}
+
+static double largest_block(unsigned index_chunks, double max_block, double limit)
+{
+	if (!fits(MIN_BLOCK_SIZE, index_chunks, limit))
+		return 0.0;
+	if (fits(max_block, index_chunks, limit))
+		return max_block;
+	double lo = MIN_BLOCK_SIZE, hi = max_block;
+	for (int i = 0; i < 32; ++i) {
+		const double mid = (lo + hi) / 2;
+		if (fits(mid, index_chunks, limit))
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return std::max(std::floor(lo / MIN_BLOCK_SIZE) * MIN_BLOCK_SIZE, MIN_BLOCK_SIZE);
+}
+
+void configure(uint64_t db_letters, const DatabaseStatistics *stats)
+{
+	if (stats && stats->sequences() > 0 && stats->letters() > 0) {
+		const double mean_len = (double)stats->letters() / stats->sequences();
+		ref_bytes_per_letter = 1.0 + REF_TITLE_BYTES_PER_LETTER + SEQUENCE_BYTES / mean_len;
+		// Each sequence is followed by one padding letter.
+		compact_letter_factor = 1.0 + 1.0 / mean_len;
+		log_stream << "Mean sequence length = " << mean_len << ", reference bytes per letter = " << ref_bytes_per_letter << endl;
+	}
+	if (config.memory_limit == 0.0)
+		return;
+	const double limit = config.memory_limit * 1e9,
+		default_block = config.mode_very_sensitive ? 0.4 : 2.0,
+		max_block = std::max(std::ceil(db_letters / 1e9 / MIN_BLOCK_SIZE) * MIN_BLOCK_SIZE, default_block);
+	const bool fixed_block = config.chunk_size != 0.0;
+	if (fixed_block && config.lowmem != 0) {
+		predicted = predict(config.chunk_size, config.lowmem);
+		if (predicted > limit)
+			message_stream << "Warning: predicted peak memory of " << predicted / 1e9 << " GB exceeds the memory limit." << endl;
+		return;
+	}
+	// Blocks that reach this size are preferred over fewer index chunks.
+	const double target = fixed_block ? config.chunk_size : default_block;
+
+	double block = 0.0;
+	unsigned chunks = 0;
+	for (unsigned c = config.lowmem != 0 ? config.lowmem : 1; c <= (config.lowmem != 0 ? config.lowmem : MAX_INDEX_CHUNKS); c *= 2) {
+		const double b = fixed_block ? (fits(config.chunk_size, c, limit) ? config.chunk_size : 0.0) : largest_block(c, max_block, limit);
+		if (b > block) {
+			block = b;
+			chunks = c;
+		}
+		if (block >= target)
+			break;
+	}
+
+	if (chunks == 0) {
+		const double b = fixed_block ? config.chunk_size : MIN_BLOCK_SIZE;
+		const unsigned c = config.lowmem != 0 ? config.lowmem : MAX_INDEX_CHUNKS;
+		std::stringstream ss;
+		ss << "Memory limit is too low. Predicted memory use for block size " << b << " and " << c << " index chunks: "
+			<< predict(b, c) / 1e9 << " GB.";
+		throw std::runtime_error(ss.str());
+	}
+
+	config.chunk_size = block;
+	config.lowmem = chunks;
+	predicted = predict(block, chunks);
+	message_stream << "Memory limit = " << config.memory_limit << " GB, block size = " << block << ", index chunks = " << chunks
+		<< ", predicted peak memory = " << predicted / 1e9 << " GB" << endl;
+}
+
+void update(size_t query_letters, size_t ref_letters, size_t query_seed_entries, size_t ref_seed_entries)
+{
+	const double p = predict(config.chunk_size, config.lowmem, query_letters, ref_letters, query_seed_entries, ref_seed_entries);
+	block_peak = std::max(block_peak, p);
+	log_stream << "Predicted memory for reference block = " << p / 1e9 << " GB" << endl;
+}
+
+void report()
+{
+	if (config.memory_limit == 0.0)
+		return;
+	message_stream << "Predicted peak memory = " << block_peak / 1e9 << " GB (initial estimate " << predicted / 1e9
+		<< " GB), peak RSS = " << getPeakRSS() / 1e9 << " GB" << endl;
+}
+
+}
@@ -0,0 +1,52 @@
+/****
+DIAMOND protein aligner
+Copyright (C) 2013-2019 Benjamin Buchfink <buchfink@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+****/
+
+#ifndef MEMORY_MODEL_H_
+#define MEMORY_MODEL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct DatabaseStatistics;
+
+// Estimate of the peak memory use of the double-indexed search. The peak is
+// reached while the query and reference blocks, the seed arrays of one index
+// chunk and the trace points loaded for computing alignments are held in memory.
+namespace MemoryModel {
+
+// Size in bytes of the trace points that are loaded at once for computing alignments.
+size_t trace_point_bytes(double block_size, unsigned index_chunks);
+// Number of entries of the largest seed array chunk of a block, assuming that the
+// seeds are spread evenly over the seed partitions.
+size_t seed_array_entries(double block_size, unsigned index_chunks);
+// Predicted peak memory in bytes for the block size in billions of letters, given the
+// letters of the query and reference blocks and the number of entries of their
+// largest seed array chunks.
+double predict(double block_size, unsigned index_chunks, size_t query_letters, size_t ref_letters, size_t query_seed_entries, size_t ref_seed_entries);
+// Chooses the block size and the number of index chunks that fit into
+// config.memory_limit, unless they have been set explicitly. The statistics of the
+// database, if available, give the per-sequence memory of the reference blocks.
+void configure(uint64_t db_letters, const DatabaseStatistics *stats = nullptr);
+// Updates the prediction with the actual sizes of the current query and reference blocks.
+void update(size_t query_letters, size_t ref_letters, size_t query_seed_entries, size_t ref_seed_entries);
+// Logs the predicted peak memory against the peak resident set size.
+void report();
+
+}
+
+#endif
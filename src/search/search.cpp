@@ -126,16 +126,18 @@ void Seed_filter::tiled_search(vector<Finger_print>::const_iterator q,
 	}	
 }
 
-void load_fps(const Packed_loc *p, size_t n, vector<Finger_print> &v, const Sequence_set &seqs)
+template<typename _pos>
+void load_fps(const _pos *p, size_t n, vector<Finger_print> &v, const Sequence_set &seqs)
 {
 	v.clear();
 	v.reserve(n);
-	const Packed_loc *end = p + n;
+	const _pos *end = p + n;
 	for (; p < end; ++p)
 		v.push_back(Finger_print(seqs.data(*p)));
 }
 
-void Seed_filter::run(const Packed_loc *q, size_t nq, const Packed_loc *s, size_t ns)
+template<typename _pos>
+void Seed_filter::run(const _pos *q, size_t nq, const _pos *s, size_t ns)
 {
 	if (config.simple_freq && !SeedComplexity::complex(query_seqs::get().data(q[0]), shapes[sid])) {
 		stats.inc(Statistics::LOW_COMPLEXITY_SEEDS);
@@ -148,4 +150,7 @@ void Seed_filter::run(const Packed_loc *q, size_t nq, const Packed_loc *s, size_
 	std::sort(hits.begin(), hits.end());
 	stats.inc(Statistics::TENTATIVE_MATCHES1, hits.size());
 	stage2_search(q, s, hits, stats, out, sid);
-}
\ No newline at end of file
+}
+
+template void Seed_filter::run<Packed_loc>(const Packed_loc *, size_t, const Packed_loc *, size_t);
+template void Seed_filter::run<uint32_t>(const uint32_t *, size_t, const uint32_t *, size_t);
\ No newline at end of file
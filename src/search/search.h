@@ -21,7 +21,15 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <stddef.h>
 
-void search_shape(unsigned sid, unsigned query_block, char *query_buffer, char *ref_buffer);
+struct SeedBuffers;
+
+// Searches all shapes and index chunks. The reference seed arrays are built in a single
+// pass using ref_buffers if it is not null. If config.index_prefetch_memory allows it, the
+// seed arrays of the next shape and index chunk are built while the current one is searched.
+void search_shapes(unsigned query_block, char *query_buffer, char *ref_buffer, SeedBuffers *ref_buffers);
+// Returns if the current query and reference blocks are searched with seed arrays of 32 bit
+// positions (CompactSeedArray).
+bool compact_seed_arrays();
 bool use_single_indexed(double coverage, size_t query_letters, size_t ref_letters);
 
 extern const double SINGLE_INDEXED_SEED_SPACE_MAX_COVERAGE;
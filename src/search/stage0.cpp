@@ -16,6 +16,8 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ****/
 
+#include <atomic>
+#include <memory>
 #include <thread>
 #include <utility>
 #include "search.h"
@@ -23,74 +25,293 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "../util/algo/radix_sort.h"
 #include "../data/reference.h"
 #include "../data/seed_array.h"
+#include "../data/seed_index.h"
 #include "../data/queries.h"
 #include "../data/frequent_seeds.h"
 #include "trace_pt_buffer.h"
 #include "align_range.h"
 #include "../util/data_structures/double_array.h"
+#include "memory_model.h"
+#include "../util/system/huge_pages.h"
 
 using namespace std;
 
+// Hands out the seed partitions of a range to the worker threads. With NUMA placement, the
+// worker threads are pinned to the nodes and take the partitions placed on their own node
+// before those of the other nodes.
+struct PartitionQueue
+{
+
+	PartitionQueue(const SeedPartitionRange &range):
+		nodes_(numa_placement() ? Numa::nodes() : 1),
+		next_(new std::atomic<unsigned>[nodes_]),
+		end_(nodes_)
+	{
+		for (unsigned n = 0; n < nodes_; ++n) {
+			next_[n] = nodes_ > 1 ? (unsigned)Numa::split(range.begin(), range.end(), n) : range.begin();
+			end_[n] = nodes_ > 1 ? (unsigned)Numa::split(range.begin(), range.end(), n + 1) : range.end();
+		}
+	}
+
+	// Pins the calling worker thread to its node and returns the node.
+	unsigned init_thread(size_t thread_id) const
+	{
+		if (nodes_ == 1)
+			return 0;
+		const unsigned node = Numa::thread_node(thread_id, config.threads_);
+		Numa::pin_thread(node);
+		return node;
+	}
+
+	bool get(unsigned node, unsigned &p)
+	{
+		for (unsigned i = 0; i < nodes_; ++i) {
+			const unsigned n = (node + i) % nodes_;
+			if (next_[n] < end_[n] && (p = next_[n]++) < end_[n])
+				return true;
+		}
+		return false;
+	}
+
+private:
+
+	const unsigned nodes_;
+	unique_ptr<std::atomic<unsigned>[]> next_;
+	vector<unsigned> end_;
+
+};
+
+// If ref_out is given, the reference seed array is only read and the join results of the
+// reference seeds are written into ref_out, which has the layout of the current index chunk.
+template<typename _pos>
 void seed_join_worker(
-	SeedArray *query_seeds,
-	SeedArray *ref_seeds,
-	Atomic<unsigned> *seedp,
-	const SeedPartitionRange *seedp_range,
-	DoubleArray<SeedArray::_pos> *query_seed_hits,
-	DoubleArray<SeedArray::_pos> *ref_seeds_hits)
+	BasicSeedArray<_pos> *query_seeds,
+	BasicSeedArray<_pos> *ref_seeds,
+	typename BasicSeedArray<_pos>::Entry *ref_out,
+	PartitionQueue *queue,
+	size_t thread_id,
+	DoubleArray<_pos> *query_seed_hits,
+	DoubleArray<_pos> *ref_seeds_hits)
 {
 	unsigned p;
 	const unsigned bits = (unsigned)ceil(shapes[0].weight_ * Reduction::reduction.bit_size_exact()) - Const::seedp_bits;
-	while ((p = (*seedp)++) < seedp_range->end()) {
-		std::pair<DoubleArray<SeedArray::_pos>, DoubleArray<SeedArray::_pos>> join = hash_join(
-			Relation<SeedArray::Entry>(query_seeds->begin(p), query_seeds->size(p)),
-			Relation<SeedArray::Entry>(ref_seeds->begin(p), ref_seeds->size(p)),
-			bits);
+	const unsigned node = queue->init_thread(thread_id);
+	while (queue->get(node, p)) {
+		std::pair<DoubleArray<_pos>, DoubleArray<_pos>> join = hash_join(
+			Relation<typename BasicSeedArray<_pos>::Entry>(query_seeds->begin(p), query_seeds->size(p)),
+			Relation<typename BasicSeedArray<_pos>::Entry>(ref_seeds->begin(p), ref_seeds->size(p)),
+			bits,
+			ref_out ? ref_out + (ref_seeds->begin(p) - ref_seeds->begin(current_range.begin())) : nullptr);
 		query_seed_hits[p] = join.first;
 		ref_seeds_hits[p] = join.second;
 	}
 }
 
-void search_worker(Atomic<unsigned> *seedp, const SeedPartitionRange *seedp_range, unsigned shape, size_t thread_id, DoubleArray<SeedArray::_pos> *query_seed_hits, DoubleArray<SeedArray::_pos> *ref_seed_hits)
+template<typename _pos>
+void search_worker(PartitionQueue *queue, unsigned shape, size_t thread_id, DoubleArray<_pos> *query_seed_hits, DoubleArray<_pos> *ref_seed_hits)
 {
 	Trace_pt_buffer::Iterator* out = new Trace_pt_buffer::Iterator(*Trace_pt_buffer::instance, thread_id);
 	Statistics stats;
 	Seed_filter seed_filter(stats, *out, shape);
 	unsigned p;
-	while ((p = (*seedp)++) < seedp_range->end())
-		for (auto it = JoinIterator<SeedArray::_pos>(query_seed_hits[p].begin(), ref_seed_hits[p].begin()); it; ++it)
+	const unsigned node = queue->init_thread(thread_id);
+	while (queue->get(node, p))
+		for (auto it = JoinIterator<_pos>(query_seed_hits[p].begin(), ref_seed_hits[p].begin()); it; ++it)
 			seed_filter.run(it.r->begin(), it.r->size(), it.s->begin(), it.s->size());
 	delete out;
 	statistics += stats;
 }
 
-void search_shape(unsigned sid, unsigned query_block, char *query_buffer, char *ref_buffer)
+template<typename _pos>
+static BasicSeedArray<_pos>* build_ref_seed_array(unsigned sid, const SeedPartitionRange &range, char *buffer, SeedBuffers *buffers, const vector<size_t> &partition)
+{
+	if (buffers) {
+		if (query_seeds_bloom != 0)
+			return new BasicSeedArray<_pos>(*ref_seqs::data_, sid, range, partition, *buffers, query_seeds_bloom);
+		else if (config.algo == Config::query_indexed)
+			return new BasicSeedArray<_pos>(*ref_seqs::data_, sid, range, partition, *buffers, query_seeds);
+		else if (query_seeds_hashed != 0)
+			return new BasicSeedArray<_pos>(*ref_seqs::data_, sid, range, partition, *buffers, query_seeds_hashed);
+		else
+			return new BasicSeedArray<_pos>(*ref_seqs::data_, sid, range, partition, *buffers, &no_filter);
+	}
+	else if (query_seeds_bloom != 0)
+		return new BasicSeedArray<_pos>(*ref_seqs::data_, sid, ref_hst.get(sid), range, ref_hst.partition(), buffer, query_seeds_bloom);
+	else if (config.algo == Config::query_indexed)
+		return new BasicSeedArray<_pos>(*ref_seqs::data_, sid, ref_hst.get(sid), range, ref_hst.partition(), buffer, query_seeds);
+	else if (query_seeds_hashed != 0)
+		return new BasicSeedArray<_pos>(*ref_seqs::data_, sid, ref_hst.get(sid), range, ref_hst.partition(), buffer, query_seeds_hashed);
+	else
+		return new BasicSeedArray<_pos>(*ref_seqs::data_, sid, ref_hst.get(sid), range, ref_hst.partition(), buffer, &no_filter);
+}
+
+template<typename _pos>
+static BasicSeedArray<_pos>* build_query_seed_array(unsigned sid, const SeedPartitionRange &range, char *buffer)
+{
+	return new BasicSeedArray<_pos>(*query_seqs::data_, sid, query_hst.get(sid), range, query_hst.partition(), buffer, &no_filter);
+}
+
+// Builds the seed arrays of the next shape and index chunk in the background, using
+// the second set of buffers. The reference seed array is not built if it is taken
+// from the seed index.
+template<typename _pos>
+struct SeedArrayBuilder
 {
-	::partition<unsigned> p(Const::seedp, config.lowmem);
-	DoubleArray<SeedArray::_pos> query_seed_hits[Const::seedp], ref_seed_hits[Const::seedp];
 
-	for (unsigned chunk = 0; chunk < p.parts; ++chunk) {
+	SeedArrayBuilder():
+		query(nullptr),
+		ref(nullptr)
+	{}
+
+	~SeedArrayBuilder()
+	{
+		if (thread_.joinable())
+			thread_.join();
+		delete query;
+		delete ref;
+	}
+
+	void start(unsigned sid, const SeedPartitionRange &range, char *query_buffer, char *ref_buffer, SeedBuffers *ref_buffers, const vector<size_t> *ref_partition)
+	{
+		thread_ = thread(&SeedArrayBuilder::build, this, sid, range, query_buffer, ref_buffer, ref_buffers, ref_partition);
+	}
+
+	// Waits for the seed arrays, which are passed to the caller.
+	void finish(BasicSeedArray<_pos> *&query_idx, BasicSeedArray<_pos> *&ref_idx)
+	{
+		thread_.join();
+		if (error_)
+			std::rethrow_exception(error_);
+		query_idx = query;
+		ref_idx = ref;
+		query = ref = nullptr;
+	}
+
+	bool running() const
+	{
+		return thread_.joinable();
+	}
+
+private:
+
+	void build(unsigned sid, SeedPartitionRange range, char *query_buffer, char *ref_buffer, SeedBuffers *ref_buffers, const vector<size_t> *ref_partition)
+	{
+		try {
+			if (!ref_seed_index)
+				ref = build_ref_seed_array<_pos>(sid, range, ref_buffer, ref_buffers, *ref_partition);
+			query = build_query_seed_array<_pos>(sid, range, query_buffer);
+		}
+		catch (...) {
+			error_ = std::current_exception();
+		}
+	}
+
+	BasicSeedArray<_pos> *query, *ref;
+	std::exception_ptr error_;
+	thread thread_;
+
+};
+
+// Size in bytes of the second set of seed array buffers that is needed for building the
+// seed arrays of the next shape and index chunk while the current one is searched.
+static size_t prefetch_bytes(bool fused, size_t entry_size)
+{
+	size_t n = entry_size * query_hst.max_chunk_size();
+	if (fused)
+		n += SeedBuffers::bytes(MemoryModel::seed_array_entries(config.chunk_size, config.lowmem), entry_size, ref_seqs::get().letters(), config.threads_, config.lowmem);
+	else if (!ref_seed_index)
+		n += entry_size * ref_hst.max_chunk_size();
+	return n;
+}
+
+static void load_ref_seed_array(SeedArray *&ref_idx, unsigned sid, const SeedPartitionRange &range)
+{
+	ref_idx = ref_seed_index->seed_array(current_ref_block, sid, range);
+}
+
+static void load_ref_seed_array(CompactSeedArray *&, unsigned, const SeedPartitionRange &)
+{
+	throw std::runtime_error("Compact seed arrays are not supported with a seed index.");
+}
+
+bool compact_seed_arrays()
+{
+	return !ref_seed_index && compact_seeds(*query_seqs::data_) && compact_seeds(*ref_seqs::data_);
+}
+
+template<typename _pos>
+static void search_shapes(unsigned query_block, char *query_buffer, char *ref_buffer, SeedBuffers *ref_buffers)
+{
+	const ::partition<unsigned> p(Const::seedp, config.lowmem);
+	const vector<size_t> ref_partition = ref_buffers ? ref_seqs::data_->partition(config.threads_) : vector<size_t>();
+	const unsigned steps = shapes.count() * p.parts;
+	const bool prefetch = steps > 1 && config.index_prefetch_memory > 0 && prefetch_bytes(ref_buffers != nullptr, sizeof(typename BasicSeedArray<_pos>::Entry)) <= config.index_prefetch_memory * 1e9;
+	log_stream << "Seed array entry size = " << sizeof(typename BasicSeedArray<_pos>::Entry) << " bytes" << endl;
+	DoubleArray<_pos> query_seed_hits[Const::seedp], ref_seed_hits[Const::seedp];
+
+	unique_ptr<char[]> query_buffer2, ref_buffer2;
+	unique_ptr<SeedBuffers> ref_buffers2;
+	if (prefetch) {
+		log_stream << "Building seed arrays of the next shape and index chunk in the background" << endl;
+		query_buffer2.reset(BasicSeedArray<_pos>::alloc_buffer(query_hst));
+		if (ref_buffers)
+			ref_buffers2.reset(new SeedBuffers(ref_seqs::get().letters(), config.threads_));
+		else if (!ref_seed_index)
+			ref_buffer2.reset(BasicSeedArray<_pos>::alloc_buffer(ref_hst));
+	}
+	char *query_buffers[] = { query_buffer, query_buffer2.get() }, *ref_buffers_[] = { ref_buffer, ref_buffer2.get() };
+	SeedBuffers *ref_seed_buffers[] = { ref_buffers, ref_buffers2.get() };
+	// The seed arrays of the seed index are only read, and the join results of the reference
+	// seeds are written into this buffer.
+	unique_ptr<char[]> ref_out;
+	size_t ref_out_size = 0;
+	SeedArrayBuilder<_pos> builder;
+	if (config.numa)
+		log_stream << "NUMA nodes = " << Numa::nodes() << endl;
+	const Numa::Counters numa_start = Numa::Counters::get();
+	const DtlbMissCounter dtlb_misses(config.verbosity >= 2);
+
+	for (unsigned step = 0; step < steps; ++step) {
+		const unsigned sid = step / p.parts, chunk = step % p.parts;
 		message_stream << "Processing query block " << query_block << ", reference block " << current_ref_block << ", shape " << sid << ", index chunk " << chunk << '.' << endl;
 		const SeedPartitionRange range(p.getMin(chunk), p.getMax(chunk));
 		current_range = range;
+		const unsigned b = prefetch ? step % 2 : 0;
 
-		task_timer timer("Building reference seed array", true);
-		SeedArray *ref_idx;
-		if (config.algo == Config::query_indexed)
-			ref_idx = new SeedArray(*ref_seqs::data_, sid, ref_hst.get(sid), range, ref_hst.partition(), ref_buffer, query_seeds);
-		else if (query_seeds_hashed != 0)
-			ref_idx = new SeedArray(*ref_seqs::data_, sid, ref_hst.get(sid), range, ref_hst.partition(), ref_buffer, query_seeds_hashed);
-		else
-			ref_idx = new SeedArray(*ref_seqs::data_, sid, ref_hst.get(sid), range, ref_hst.partition(), ref_buffer, &no_filter);
-
-		timer.go("Building query seed array");
-		SeedArray *query_idx = new SeedArray(*query_seqs::data_, sid, query_hst.get(sid), range, query_hst.partition(), query_buffer, &no_filter);
+		task_timer timer;
+		BasicSeedArray<_pos> *query_idx = nullptr, *ref_idx = nullptr;
+		if (builder.running()) {
+			timer.go("Waiting for seed arrays");
+			builder.finish(query_idx, ref_idx);
+		}
+		if (ref_seed_index) {
+			timer.go("Loading reference seed array");
+			load_ref_seed_array(ref_idx, sid, range);
+			const size_t n = ref_idx->begin(range.end()) - ref_idx->begin(range.begin());
+			if (n > ref_out_size) {
+				ref_out.reset(new char[n * sizeof(typename BasicSeedArray<_pos>::Entry)]);
+				HugePages::advise(ref_out.get(), n * sizeof(typename BasicSeedArray<_pos>::Entry));
+				ref_out_size = n;
+			}
+		}
+		else if (!ref_idx) {
+			timer.go("Building reference seed array");
+			ref_idx = build_ref_seed_array<_pos>(sid, range, ref_buffers_[b], ref_seed_buffers[b], ref_partition);
+		}
+		if (!query_idx) {
+			timer.go("Building query seed array");
+			query_idx = build_query_seed_array<_pos>(sid, range, query_buffers[b]);
+		}
+		if (prefetch && step + 1 < steps) {
+			const unsigned next_chunk = (step + 1) % p.parts;
+			builder.start((step + 1) / p.parts, SeedPartitionRange(p.getMin(next_chunk), p.getMax(next_chunk)), query_buffers[1 - b], ref_buffers_[1 - b], ref_seed_buffers[1 - b], &ref_partition);
+		}
 
 		timer.go("Computing hash join");
-		Atomic<unsigned> seedp(range.begin());
+		PartitionQueue join_queue(range);
 		vector<thread> threads;
 		for (size_t i = 0; i < config.threads_; ++i)
-			threads.emplace_back(seed_join_worker, query_idx, ref_idx, &seedp, &range, query_seed_hits, ref_seed_hits);
+			threads.emplace_back(seed_join_worker<_pos>, query_idx, ref_idx, ref_seed_index ? (typename BasicSeedArray<_pos>::Entry*)ref_out.get() : nullptr, &join_queue, i, query_seed_hits, ref_seed_hits);
 		for (auto &t : threads)
 			t.join();
 
@@ -98,14 +319,32 @@ void search_shape(unsigned sid, unsigned query_block, char *query_buffer, char *
 		frequent_seeds.build(sid, range, query_seed_hits, ref_seed_hits);
 
 		timer.go("Searching alignments");
-		seedp = range.begin();
+		PartitionQueue search_queue(range);
 		threads.clear();
 		for (size_t i = 0; i < config.threads_; ++i)
-			threads.emplace_back(search_worker, &seedp, &range, sid, i, query_seed_hits, ref_seed_hits);
+			threads.emplace_back(search_worker<_pos>, &search_queue, sid, i, query_seed_hits, ref_seed_hits);
 		for (auto &t : threads)
 			t.join();
 
 		delete ref_idx;
 		delete query_idx;
+		if (ref_seed_index)
+			ref_seed_index->release(current_ref_block, sid, range);
+	}
+
+	dtlb_misses.report("seed search", verbose_stream);
+	if (config.numa) {
+		const Numa::Counters c = Numa::Counters::get();
+		const uint64_t local = c.local - numa_start.local, remote = c.remote - numa_start.remote;
+		verbose_stream << "NUMA page allocations: local = " << local << ", remote = " << remote << " ("
+			<< (local + remote > 0 ? 100.0 * local / (local + remote) : 100.0) << "% local)" << endl;
 	}
-}
\ No newline at end of file
+}
+
+void search_shapes(unsigned query_block, char *query_buffer, char *ref_buffer, SeedBuffers *ref_buffers)
+{
+	if (compact_seed_arrays())
+		search_shapes<uint32_t>(query_block, query_buffer, ref_buffer, ref_buffers);
+	else
+		search_shapes<Packed_loc>(query_block, query_buffer, ref_buffer, ref_buffers);
+}
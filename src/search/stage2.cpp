@@ -32,8 +32,9 @@ template<typename _score> thread_local vector<score_vector<_score>> DP_matrix<_s
 
 thread_local vector<sequence> hit_filter::subjects_;
 
+template<typename _pos>
 void search_query_offset(Loc q,
-	const Packed_loc *s,
+	const _pos *s,
 	vector<Stage1_hit>::const_iterator hits,
 	vector<Stage1_hit>::const_iterator hits_end,
 	Statistics &stats,
@@ -66,8 +67,9 @@ void search_query_offset(Loc q,
 
 #else
 
+template<typename _pos>
 void search_query_offset(Loc q,
-	const Packed_loc *s,
+	const _pos *s,
 	vector<Stage1_hit>::const_iterator hits,
 	vector<Stage1_hit>::const_iterator hits_end,
 	Statistics &stats,
@@ -115,8 +117,9 @@ void search_query_offset(Loc q,
 
 #endif
 
-void stage2_search(const Packed_loc *q,
-	const Packed_loc *s,
+template<typename _pos>
+void stage2_search(const _pos *q,
+	const _pos *s,
 	const vector<Stage1_hit> &hits,
 	Statistics &stats,
 	Trace_pt_buffer::Iterator &out,
@@ -126,4 +129,7 @@ void stage2_search(const Packed_loc *q,
 	Map_t map(hits.begin(), hits.end());
 	for (Map_t::Iterator i = map.begin(); i.valid(); ++i)
 		search_query_offset(q[i.begin()->q], s, i.begin(), i.end(), stats, out, sid);
-}
\ No newline at end of file
+}
+
+template void stage2_search<Packed_loc>(const Packed_loc *, const Packed_loc *, const vector<Stage1_hit> &, Statistics &, Trace_pt_buffer::Iterator &, const unsigned);
+template void stage2_search<uint32_t>(const uint32_t *, const uint32_t *, const vector<Stage1_hit> &, Statistics &, Trace_pt_buffer::Iterator &, const unsigned);
\ No newline at end of file
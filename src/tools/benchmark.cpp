@@ -1,11 +1,24 @@
 #include <chrono>
 #include <utility>
+#include <memory>
+#include <unordered_set>
 #include "../basic/sequence.h"
 #include "../basic/score_matrix.h"
 #include "../dp/score_vector.h"
 #include "../util/simd/transpose.h"
 #include "../dp/swipe/swipe.h"
 #include "../dp/dp.h"
+#include "../basic/packed_sequence.h"
+#include "../basic/translate.h"
+#include "../basic/config.h"
+#include "../basic/reduction.h"
+#include "../basic/shape_config.h"
+#include "../data/seed_array.h"
+#include "../data/seed_set.h"
+#include "../search/memory_model.h"
+#include "../data/reference.h"
+#include "../util/io/temp_file.h"
+#include "../basic/masking.h"
 
 using std::vector;
 using std::chrono::high_resolution_clock;
@@ -110,6 +123,316 @@ void benchmark_transpose() {
 	cout << "Matrix transpose 16x16 bytes:\t" << (double)duration_cast<std::chrono::nanoseconds>(high_resolution_clock::now() - t1).count() / (n * 256) * 1000 << " ps/Letter" << endl;
 }
 
+void packed_decode() {
+	static const size_t n = 10000llu, groups = 1 << 12;
+	vector<Letter> letters(groups * PACKED_GROUP_LETTERS);
+	vector<uint8_t> packed(groups * PACKED_GROUP_BYTES);
+	for (size_t i = 0; i < letters.size(); ++i)
+		letters[i] = Letter(i % 25);
+	pack_5bit(letters.data(), groups, packed.data());
+
+	high_resolution_clock::time_point t1 = high_resolution_clock::now();
+	for (size_t i = 0; i < n; ++i) {
+		unpack_5bit(packed.data(), groups, letters.data());
+		packed[0] = letters[i % letters.size()];
+	}
+	cout << "Packed sequence decode:\t\t" << (double)duration_cast<std::chrono::nanoseconds>(high_resolution_clock::now() - t1).count() / (n * letters.size()) * 1000 << " ps/Letter" << endl;
+}
+
+// Builds a plain and a packed database from sequences with low complexity regions and
+// checks that both return the same sequences including the soft mask set by makedb.
+void packed_database() {
+	static const size_t seqs = 2000llu, len = 300llu;
+	static const char *alphabet = "ARNDCQEGHILKMFPSTWYV";
+	const string dir = TempFile::get_temp_dir(), fasta = (dir.empty() ? dir : dir + dir_separator) + "diamond-benchmark.faa";
+	{
+		OutputFile out(fasta);
+		uint64_t x = 1;
+		string s;
+		for (size_t i = 0; i < seqs; ++i) {
+			s = ">" + std::to_string(i) + "\n";
+			for (size_t j = 0; j < len; ++j) {
+				x = x * 6364136223846793005llu + 1442695040888963407llu;
+				s += i % 3 == 0 && j >= 100 && j < 140 ? 'Q' : alphabet[(x >> 33) % 20];
+			}
+			s += '\n';
+			out.write(s.data(), s.length());
+		}
+		out.close();
+	}
+	const string input_ref_file = config.input_ref_file;
+	const bool pack_seqs = config.pack_seqs;
+	const unsigned command = config.command;
+	config.input_ref_file = fasta;
+	config.command = Config::makedb;
+	vector<vector<Letter>> db_seqs[2];
+	for (int packed = 0; packed < 2; ++packed) {
+		config.pack_seqs = packed != 0;
+		TempFile *tmp;
+		make_db(&tmp);
+		DatabaseFile db(*tmp);
+		delete tmp;
+		string id;
+		db.seek_direct();
+		for (size_t i = 0; i < db.ref_header.sequences; ++i) {
+			db_seqs[packed].emplace_back();
+			db.read_seq(id, db_seqs[packed].back());
+			id.clear();
+		}
+		db.close();
+	}
+	config.input_ref_file = input_ref_file;
+	config.pack_seqs = pack_seqs;
+	config.command = command;
+	remove(fasta.c_str());
+	size_t masked = 0;
+	for (const vector<Letter> &v : db_seqs[0])
+		masked += std::count_if(v.begin(), v.end(), [](Letter l) { return (l & Masking::bit_mask) != 0; });
+	if (db_seqs[0] != db_seqs[1])
+		throw std::runtime_error("Packed database sequences differ from the plain database.");
+	cout << "Packed database:		" << db_seqs[1].size() << " sequences, " << masked << " soft-masked letters identical" << endl;
+}
+
+void translate() {
+	static const size_t n = 1000llu, len = 100000llu;
+	vector<Letter> dna(len), proteins[6], buf;
+	for (size_t i = 0; i < len; ++i)
+		dna[i] = Letter((i * 7 + i / 5) % 4);
+	unsigned good_frames;
+
+	high_resolution_clock::time_point t1 = high_resolution_clock::now();
+	for (size_t i = 0; i < n; ++i) {
+		Translator::translate(dna, proteins);
+		global_int = Translator::computeGoodFrames(proteins, 20);
+	}
+	cout << "Six-frame translation:\t\t" << (double)(n * len) / duration_cast<std::chrono::nanoseconds>(high_resolution_clock::now() - t1).count() * 1000 << " Mbases/s" << endl;
+
+	t1 = high_resolution_clock::now();
+	for (size_t i = 0; i < n; ++i) {
+		Translator::translate(sequence(dna), proteins, 20, good_frames, buf);
+		global_int = good_frames;
+	}
+	cout << "Six-frame translation (SIMD):\t" << (double)(n * len) / duration_cast<std::chrono::nanoseconds>(high_resolution_clock::now() - t1).count() * 1000 << " Mbases/s" << endl;
+}
+
+// Sets the reduction, shapes and index chunks for the seed benchmarks and restores the previous settings.
+struct SeedSettings
+{
+	SeedSettings():
+		reduction(Reduction::reduction),
+		shapes(::shapes),
+		lowmem(config.lowmem)
+	{
+		Config::set_option(config.lowmem, 4u);
+		Reduction::reduction = Reduction("A KR EDNQ C G H ILVM FYW P ST");
+		::shapes = shape_config(8, 1, vector<string>());
+	}
+	~SeedSettings()
+	{
+		Reduction::reduction = reduction;
+		::shapes = shapes;
+		config.lowmem = lowmem;
+	}
+	const Reduction reduction;
+	const shape_config shapes;
+	const unsigned lowmem;
+};
+
+void seed_array() {
+	static const size_t seqs = 100000llu, len = 300llu;
+	const SeedSettings settings;
+	const unsigned chunks = config.lowmem;
+	Sequence_set ss;
+	vector<Letter> seq(len);
+	uint64_t x = 1;
+	for (size_t i = 0; i < seqs; ++i) {
+		for (size_t j = 0; j < len; ++j) {
+			x = x * 6364136223846793005llu + 1442695040888963407llu;
+			seq[j] = Letter((x >> 33) % 20);
+		}
+		ss.push_back(seq);
+	}
+	ss.finish_reserve();
+	::partition<unsigned> p(Const::seedp, chunks);
+
+	high_resolution_clock::time_point t1 = high_resolution_clock::now();
+	Partitioned_histogram hst(ss, false, &no_filter);
+	const double hst_time = (double)duration_cast<std::chrono::nanoseconds>(high_resolution_clock::now() - t1).count();
+	char *buffer = SeedArray::alloc_buffer(hst);
+	memset(buffer, 0, sizeof(SeedArray::Entry) * hst.max_chunk_size());
+	vector<size_t> sizes, sums;
+	const bool streaming_seeds = config.streaming_seeds;
+	for (int streaming = 0; streaming < 2; ++streaming) {
+		config.streaming_seeds = streaming != 0;
+		double t = hst_time;
+		for (unsigned chunk = 0; chunk < chunks; ++chunk) {
+			const SeedPartitionRange range(p.getMin(chunk), p.getMax(chunk));
+			t1 = high_resolution_clock::now();
+			SeedArray sa(ss, 0, hst.get(0), range, hst.partition(), buffer, &no_filter);
+			t += (double)duration_cast<std::chrono::nanoseconds>(high_resolution_clock::now() - t1).count();
+			for (unsigned i = range.begin(); i < range.end(); ++i) {
+				size_t sum = 0;
+				for (const SeedArray::Entry *e = sa.begin(i); e < sa.begin(i) + sa.size(i); ++e)
+					sum = sum * 31 + e->key + (uint64_t)e->value;
+				if (streaming == 0) {
+					sizes.push_back(sa.size(i));
+					sums.push_back(sum);
+				}
+				else if (sum != sums[i])
+					throw std::runtime_error("Seed array mismatch.");
+			}
+		}
+		cout << (streaming ? "Seed array (streaming stores):\t" : "Seed array (histogram):\t\t") << (double)(seqs * len) / t * 1000 << " Mletters/s" << endl;
+	}
+	config.streaming_seeds = streaming_seeds;
+
+	t1 = high_resolution_clock::now();
+	const vector<size_t> seq_partition = ss.partition(config.threads_);
+	SeedBuffers buffers(ss.letters(), config.threads_);
+	for (unsigned chunk = 0; chunk < chunks; ++chunk) {
+		const SeedPartitionRange range(p.getMin(chunk), p.getMax(chunk));
+		SeedArray sa(ss, 0, range, seq_partition, buffers, &no_filter);
+		for (unsigned i = range.begin(); i < range.end(); ++i)
+			if (sa.size(i) != sizes[i])
+				throw std::runtime_error("Seed array mismatch.");
+	}
+	cout << "Seed array (single pass):\t" << (double)(seqs * len) / duration_cast<std::chrono::nanoseconds>(high_resolution_clock::now() - t1).count() * 1000 << " Mletters/s" << endl;
+	delete[] buffer;
+}
+
+static void random_seqs(Sequence_set &ss, size_t seqs, size_t len, uint64_t x)
+{
+	vector<Letter> seq(len);
+	for (size_t i = 0; i < seqs; ++i) {
+		for (size_t j = 0; j < len; ++j) {
+			x = x * 6364136223846793005llu + 1442695040888963407llu;
+			seq[j] = Letter((x >> 33) % 20);
+		}
+		ss.push_back(seq);
+	}
+	ss.finish_reserve();
+}
+
+struct Seed_collector
+{
+	Seed_collector(vector<uint64_t> &seeds, vector<size_t> &shape_ids):
+		seeds(seeds),
+		shape_ids(shape_ids)
+	{}
+	bool operator()(uint64_t seed, uint64_t pos, size_t shape)
+	{
+		seeds.push_back(seed);
+		shape_ids.push_back(shape);
+		return true;
+	}
+	void finish()
+	{}
+	vector<uint64_t> &seeds;
+	vector<size_t> &shape_ids;
+};
+
+void seed_filter() {
+	static const size_t seqs = 20000llu, len = 300llu, batch = 64;
+	const SeedSettings settings;
+	Sequence_set query, ref;
+	random_seqs(query, seqs, len, 1);
+	random_seqs(ref, seqs, len, 2);
+	vector<uint64_t> seeds, query_seeds;
+	vector<size_t> shape_ids, query_shape_ids;
+	PtrVector<Seed_collector> cb;
+	cb.push_back(new Seed_collector(seeds, shape_ids));
+	ref.enum_seeds(cb, ref.partition(1), 0, shapes.count(), &no_filter);
+	cb.clear();
+	cb.push_back(new Seed_collector(query_seeds, query_shape_ids));
+	query.enum_seeds(cb, query.partition(1), 0, shapes.count(), &no_filter);
+	std::unordered_set<uint64_t> query_set;
+	for (size_t i = 0; i < query_seeds.size(); ++i)
+		query_set.insert(Bloom_seed_set::hash(query_seeds[i], query_shape_ids[i]));
+	const size_t n = seeds.size();
+	vector<bool> exact(n);
+	size_t hits = 0;
+	for (size_t i = 0; i < n; ++i) {
+		exact[i] = query_set.find(Bloom_seed_set::hash(seeds[i], shape_ids[i])) != query_set.end();
+		hits += exact[i];
+	}
+	std::unique_ptr<bool[]> out(new bool[n]);
+
+	Hashed_seed_set hashed(query);
+	Bloom_seed_set bloom(query);
+	high_resolution_clock::time_point t1 = high_resolution_clock::now();
+	for (size_t i = 0; i < n; ++i)
+		out[i] = hashed.contains(seeds[i], shape_ids[i]);
+	cout << "Seed set probes (hash table):\t" << (double)n / duration_cast<std::chrono::nanoseconds>(high_resolution_clock::now() - t1).count() * 1000 << " M/s" << endl;
+	size_t fp = 0;
+	for (size_t i = 0; i < n; ++i)
+		fp += out[i] && !exact[i];
+	cout << "Hash table false positive rate:\t" << (double)fp / (n - hits) << endl;
+
+	fp = 0;
+	t1 = high_resolution_clock::now();
+	for (size_t i = 0; i < n; ++i)
+		out[i] = bloom.contains(seeds[i], shape_ids[i]);
+	cout << "Seed set probes (Bloom):\t" << (double)n / duration_cast<std::chrono::nanoseconds>(high_resolution_clock::now() - t1).count() * 1000 << " M/s" << endl;
+
+	t1 = high_resolution_clock::now();
+	for (size_t i = 0; i < n; i += batch)
+		bloom.contains(&seeds[i], &shape_ids[i], std::min(batch, n - i), &out[i]);
+	cout << "Seed set probes (Bloom, batch):\t" << (double)n / duration_cast<std::chrono::nanoseconds>(high_resolution_clock::now() - t1).count() * 1000 << " M/s" << endl;
+
+	for (size_t i = 0; i < n; ++i) {
+		if (exact[i] && !out[i])
+			throw std::runtime_error("Bloom filter false negative.");
+		fp += out[i] && !exact[i];
+	}
+	cout << "Bloom filter false positive rate:\t" << (double)fp / (n - hits) << " (" << bloom.bytes() / 1e6 << " MB, " << (double)hits / n << " of the seeds contained)" << endl;
+}
+
+// Checks the memory model against the memory held for prefetching the next query chunk
+// and for building the reference seed arrays in a single pass.
+void memory_model() {
+	static const size_t seqs = 100000llu, len = 300llu;
+	const SeedSettings settings;
+	const unsigned chunks = config.lowmem;
+	Sequence_set ss;
+	random_seqs(ss, seqs, len, 1);
+	const size_t letters = ss.letters(), block_bytes = ss.raw_len() + (ss.get_length() + 1) * sizeof(size_t);
+	::partition<unsigned> p(Const::seedp, chunks);
+	const vector<size_t> seq_partition = ss.partition(config.threads_);
+	SeedBuffers buffers(letters, config.threads_);
+	size_t entries = 0;
+	for (unsigned chunk = 0; chunk < chunks; ++chunk) {
+		const SeedPartitionRange range(p.getMin(chunk), p.getMax(chunk));
+		CompactSeedArray sa(ss, 0, range, seq_partition, buffers, &no_filter);
+		size_t n = 0;
+		for (unsigned i = range.begin(); i < range.end(); ++i)
+			n += sa.size(i);
+		entries = std::max(entries, n);
+	}
+
+	const double query_prefetch_memory = config.query_prefetch_memory, index_prefetch_memory = config.index_prefetch_memory;
+	const bool fused_seeds = config.fused_seeds;
+	config.index_prefetch_memory = 0.0;
+	config.query_prefetch_memory = 0.0;
+	config.fused_seeds = false;
+	// Block size 0 leaves out the trace points, which would otherwise cover the reference seed array.
+	const double base = MemoryModel::predict(0.0, chunks, letters, letters, 0, 0);
+	config.query_prefetch_memory = block_bytes * 2 / 1e9;
+	const double prefetch = MemoryModel::predict(0.0, chunks, letters, letters, 0, 0) - base;
+	config.query_prefetch_memory = 0.0;
+	config.fused_seeds = true;
+	const double fused = MemoryModel::predict(0.0, chunks, letters, letters, 0, entries) - base;
+	config.query_prefetch_memory = query_prefetch_memory;
+	config.index_prefetch_memory = index_prefetch_memory;
+	config.fused_seeds = fused_seeds;
+
+	cout << "Memory model (query prefetch):\t" << prefetch / 1e6 << " MB predicted, " << block_bytes / 1e6 << " MB used" << endl;
+	cout << "Memory model (seed buffers):\t" << fused / 1e6 << " MB predicted, " << buffers.allocated() / 1e6 << " MB used" << endl;
+	if (prefetch < block_bytes)
+		throw std::runtime_error("Memory model does not cover the prefetched query chunk.");
+	if (fused < buffers.allocated())
+		throw std::runtime_error("Memory model does not cover the seed array buffers.");
+}
+
 void swipe_cell_update() {
 	static const size_t n = 1000000000llu;
 	high_resolution_clock::time_point t1 = high_resolution_clock::now();
@@ -137,9 +460,10 @@ void swipe(const sequence &s1, const sequence &s2) {
 	sequence target[16];
 	std::fill(target, target + 16, s2);
 	static const size_t n = 10000llu;
+	DpStat stat;
 	high_resolution_clock::time_point t1 = high_resolution_clock::now();
 	for (size_t i = 0; i < n; ++i) {
-		vector<int> v = DP::Swipe::swipe(s1, target, target + 16);
+		vector<int> v = DP::Swipe::swipe(s1, target, target + 16, stat);
 		global_int = v[0];
 	}
 	cout << "SWIPE:\t\t\t\t" << (double)duration_cast<std::chrono::nanoseconds>(high_resolution_clock::now() - t1).count() / (n * s1.length() * s2.length() * 16) * 1000 << " ps/Cell" << endl;
@@ -151,9 +475,10 @@ void banded_swipe(const sequence &s1, const sequence &s2) {
 	for (size_t i = 0; i < 8; ++i)
 		target.emplace_back(s2, -32, 32, &out);
 	static const size_t n = 10000llu;
+	DpStat stat;
 	high_resolution_clock::time_point t1 = high_resolution_clock::now();
 	for (size_t i = 0; i < n; ++i) {
-		DP::BandedSwipe::swipe(s1, target.begin(), target.end());
+		DP::BandedSwipe::swipe(s1, target.begin(), target.end(), stat);
 		out.clear();
 	}
 	cout << "Banded SWIPE:\t\t\t" << (double)duration_cast<std::chrono::nanoseconds>(high_resolution_clock::now() - t1).count() / (n * s1.length() * 65 * 8) * 1000 << " ps/Cell" << endl;
@@ -170,6 +495,12 @@ void benchmark() {
 	Benchmark::benchmark_ungapped(s1, s2);
 	Benchmark::benchmark_ungapped_sse(s1, s2);
 	Benchmark::benchmark_transpose();
+	Benchmark::packed_decode();
+	Benchmark::packed_database();
+	Benchmark::translate();
+	Benchmark::seed_array();
+	Benchmark::seed_filter();
+	Benchmark::memory_model();
 	Benchmark::swipe_cell_update();
 	Benchmark::swipe(s1, s2);
 	Benchmark::banded_swipe(s1, s2);
@@ -28,6 +28,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "radix_cluster.h"
 #include "../data_structures/hash_table.h"
 #include "../data_structures/double_array.h"
+#include "../system/huge_pages.h"
 
 using std::cerr;
 using std::endl;
@@ -47,13 +48,15 @@ struct RelPtr
 	unsigned r, s;
 };
 
+// The entries of S that have a match are collected in hits_s, which may be the memory of S.
 template<typename _t>
 void hash_table_join(
 	const Relation<_t> &R,
 	const Relation<_t> &S,
 	unsigned shift,
 	DoubleArray<typename _t::Value> &dst_r,
-	DoubleArray<typename _t::Value> &dst_s)
+	DoubleArray<typename _t::Value> &dst_s,
+	_t *hits_s)
 {
 	typedef HashTable<unsigned, RelPtr, ExtractBits> Table;
 	
@@ -67,8 +70,8 @@ void hash_table_join(
 		i->key = unsigned(p - table.data());
 	}
 
-	_t *hit_s = S.data;
-	for (_t *i = S.data; i < S.end(); ++i) {
+	_t *hit_s = hits_s;
+	for (const _t *i = S.data; i < S.end(); ++i) {
 		if ((p = table.find_entry(i->key))) {
 			++p->s;
 			hit_s->value = i->value;
@@ -102,7 +105,7 @@ void hash_table_join(
 		}
 	}
 
-	for (const _t *i = S.data; i < hit_s; ++i) {
+	for (const _t *i = hits_s; i < hit_s; ++i) {
 		p = &table.data()[i->key];
 		dst_s[p->s] = i->value;
 		p->s += sizeof(typename _t::Value);
@@ -116,18 +119,20 @@ void table_join(
 	unsigned total_bits,
 	unsigned shift,
 	DoubleArray<typename _t::Value> &dst_r,
-	DoubleArray<typename _t::Value> &dst_s)
+	DoubleArray<typename _t::Value> &dst_s,
+	_t *hits_s)
 {
 	const unsigned keys = 1 << (total_bits - shift);
 	ExtractBits key(keys, shift);
 	RelPtr *table = (RelPtr*)calloc(keys, sizeof(RelPtr));
+	HugePages::advise(table, keys * sizeof(RelPtr));
 	RelPtr *p;
 
 	for (_t *i = R.data; i < R.end(); ++i)
 		++table[key(i->key)].r;
 
-	_t *hit_s = S.data;
-	for (_t *i = S.data; i < S.end(); ++i) {
+	_t *hit_s = hits_s;
+	for (const _t *i = S.data; i < S.end(); ++i) {
 		if ((p = &table[key(i->key)])->r) {
 			++p->s;
 			std::copy(i, i + 1, hit_s++);
@@ -159,7 +164,7 @@ void table_join(
 		}
 	}
 
-	for (const _t *i = S.data; i < hit_s; ++i) {
+	for (const _t *i = hits_s; i < hit_s; ++i) {
 		p = &table[key(i->key)];
 		dst_s[p->s] = i->value;
 		p->s += sizeof(typename _t::Value);
@@ -168,12 +173,15 @@ void table_join(
 	free(table);
 }
 
+// home_s has the size of S and takes the matching entries of S and the scratch space of the
+// clusters. S is only read if home_s is not the memory of S.
 template<typename _t>
 void hash_join(
 	Relation<_t> R,
 	Relation<_t> S,
 	_t *dst_r,
 	_t *dst_s,
+	_t *home_s,
 	DoubleArray<typename _t::Value> &out_r,
 	DoubleArray<typename _t::Value> &out_s,
 	unsigned total_bits = 32,
@@ -185,9 +193,9 @@ void hash_join(
 	if (R.n < config.join_split_size || key_bits < config.join_split_key_len) {
 		DoubleArray<typename _t::Value> tmp_r((void*)dst_r), tmp_s((void*)dst_s);
 		if (next_power_of_2(R.n * config.join_ht_factor) < 1llu << key_bits)
-			hash_table_join(R, S, shift, tmp_r, tmp_s);
+			hash_table_join(R, S, shift, tmp_r, tmp_s, home_s);
 		else
-			table_join(R, S, total_bits, shift, tmp_r, tmp_s);
+			table_join(R, S, total_bits, shift, tmp_r, tmp_s, home_s);
 		out_r.append(tmp_r);
 		out_s.append(tmp_s);
 	}
@@ -198,23 +206,28 @@ void hash_join(
 		radix_cluster(S, shift, dst_s, hstS);
 
 		shift += config.radix_bits;
-		hash_join(Relation<_t>(dst_r, hstR[0]), Relation<_t>(dst_s, hstS[0]), R.data, S.data, out_r, out_s, total_bits, shift);
+		hash_join(Relation<_t>(dst_r, hstR[0]), Relation<_t>(dst_s, hstS[0]), R.data, home_s, dst_s, out_r, out_s, total_bits, shift);
 		for (unsigned i = 1; i < clusters; ++i)
-			hash_join(Relation<_t>(dst_r + hstR[i - 1], hstR[i] - hstR[i - 1]), Relation<_t>(dst_s + hstS[i - 1], hstS[i] - hstS[i - 1]), R.data + hstR[i - 1], S.data + hstS[i - 1], out_r, out_s, total_bits, shift);
+			hash_join(Relation<_t>(dst_r + hstR[i - 1], hstR[i] - hstR[i - 1]), Relation<_t>(dst_s + hstS[i - 1], hstS[i] - hstS[i - 1]), R.data + hstR[i - 1], home_s + hstS[i - 1], dst_s + hstS[i - 1], out_r, out_s, total_bits, shift);
 
 		delete[] hstR;
 		delete[] hstS;
 	}
 }
 
+// Joins R and S on their keys. The result for R is written into the memory of R. The result for
+// S is written into out_s, which has the size of S, or into the memory of S if out_s is null.
+// S is only read in the first case, so that it can be shared.
 template<typename _t>
-std::pair<DoubleArray<typename _t::Value>, DoubleArray<typename _t::Value>> hash_join(Relation<_t> R, Relation<_t> S, unsigned total_bits = 32) {
-	_t *buf_r = (_t*)malloc(sizeof(_t) * R.n), *buf_s = (_t*)malloc(sizeof(_t) * S.n);
-	DoubleArray<typename _t::Value> out_r((void*)R.data), out_s((void*)S.data);
-	hash_join(R, S, buf_r, buf_s, out_r, out_s, total_bits);
+std::pair<DoubleArray<typename _t::Value>, DoubleArray<typename _t::Value>> hash_join(Relation<_t> R, Relation<_t> S, unsigned total_bits = 32, _t *out_s = nullptr) {
+	_t *buf_r = (_t*)malloc(sizeof(_t) * R.n), *buf_s = (_t*)malloc(sizeof(_t) * S.n), *home_s = out_s ? out_s : S.data;
+	HugePages::advise(buf_r, sizeof(_t) * R.n);
+	HugePages::advise(buf_s, sizeof(_t) * S.n);
+	DoubleArray<typename _t::Value> out_r((void*)R.data), out((void*)home_s);
+	hash_join(R, S, buf_r, buf_s, home_s, out_r, out, total_bits);
 	free(buf_r);
 	free(buf_s);
-	return { out_r, out_s };
+	return { out_r, out };
 }
 
 #endif
\ No newline at end of file
@@ -28,6 +28,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "log_stream.h"
 #include "../util/ptr_vector.h"
 #include "io/async_file.h"
+#include "system/huge_pages.h"
 
 using std::vector;
 using std::string;
@@ -110,6 +111,8 @@ struct Async_buffer
 		}
 		log_stream << "Async_buffer.load() " << size << "(" << (double)size*sizeof(_t) / (1 << 30) << " GB)" << endl;
 		total_size += size;
+		data.reserve(size);
+		HugePages::advise(data.data(), size * sizeof(_t));
 		data.resize(size);
 		_t* ptr = data.data();
 		input_range.first = begin(bins_processed_);
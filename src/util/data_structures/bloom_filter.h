@@ -0,0 +1,148 @@
+/****
+DIAMOND protein aligner
+Copyright (C) 2013-2019 Benjamin Buchfink <buchfink@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+****/
+
+#ifndef BLOOM_FILTER_H_
+#define BLOOM_FILTER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <new>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include "../simd.h"
+#include "../system/huge_pages.h"
+
+// Split block Bloom filter over 64 bit hash values. A key sets one bit in each of the eight
+// 32 bit words of a 32 byte block, so that a lookup reads a single cache line and tests all
+// eight bits at once. The block is chosen by the upper and the bits by the lower half of the hash.
+struct BlockedBloomFilter
+{
+
+	BlockedBloomFilter(size_t keys, double bits_per_key):
+		blocks_(std::max((size_t)(keys * bits_per_key / 256), (size_t)1)),
+		mem_((uint32_t*)calloc(blocks_ * BLOCK_WORDS + CACHE_LINE_WORDS, sizeof(uint32_t)))
+	{
+		if (!mem_)
+			throw std::bad_alloc();
+		const size_t offset = ((uintptr_t)mem_ / sizeof(uint32_t)) % CACHE_LINE_WORDS;
+		data_ = mem_ + (offset == 0 ? 0 : CACHE_LINE_WORDS - offset);
+		HugePages::advise(data_, bytes());
+	}
+
+	~BlockedBloomFilter()
+	{
+		free(mem_);
+	}
+
+	void insert(uint64_t hash)
+	{
+		uint32_t *b = block(hash);
+		for (unsigned i = 0; i < BLOCK_WORDS; ++i)
+			b[i] |= 1u << (((uint32_t)hash * salt()[i]) >> 27);
+	}
+
+	// Thread-safe variant of insert. Words that already hold their bit are not written, so that
+	// threads filling a populated filter mostly read shared cache lines.
+	void insert_atomic(uint64_t hash)
+	{
+		uint32_t *b = block(hash);
+		for (unsigned i = 0; i < BLOCK_WORDS; ++i) {
+			const uint32_t m = 1u << (((uint32_t)hash * salt()[i]) >> 27);
+			if ((b[i] & m) == 0)
+#ifdef _MSC_VER
+				_InterlockedOr((volatile long*)&b[i], (long)m);
+#else
+				__sync_fetch_and_or(&b[i], m);
+#endif
+		}
+	}
+
+	bool contains(uint64_t hash) const
+	{
+		const uint32_t *b = block(hash);
+#ifdef __SSE4_1__
+		// 2^i is computed as the float with exponent i, which converts to 0x80000000 for i = 31.
+		const __m128i h = _mm_set1_epi32((int)(uint32_t)hash), one = _mm_set1_epi32(0x3f800000);
+		const __m128i i0 = _mm_srli_epi32(_mm_mullo_epi32(h, _mm_loadu_si128((const __m128i*)salt())), 27),
+			i1 = _mm_srli_epi32(_mm_mullo_epi32(h, _mm_loadu_si128((const __m128i*)(salt() + 4))), 27),
+			m0 = _mm_cvttps_epi32(_mm_castsi128_ps(_mm_add_epi32(_mm_slli_epi32(i0, 23), one))),
+			m1 = _mm_cvttps_epi32(_mm_castsi128_ps(_mm_add_epi32(_mm_slli_epi32(i1, 23), one)));
+		return (_mm_testc_si128(_mm_load_si128((const __m128i*)b), m0) & _mm_testc_si128(_mm_load_si128((const __m128i*)(b + 4)), m1)) != 0;
+#else
+		for (unsigned i = 0; i < BLOCK_WORDS; ++i)
+			if ((b[i] & (1u << (((uint32_t)hash * salt()[i]) >> 27))) == 0)
+				return false;
+		return true;
+#endif
+	}
+
+	// Looks up n hash values, prefetching the blocks of the values ahead so that the cache
+	// misses of a batch overlap.
+	void contains(const uint64_t *hash, size_t n, bool *out) const
+	{
+#ifdef __SSE2__
+		for (size_t i = 0; i < std::min(n, (size_t)PREFETCH_DISTANCE); ++i)
+			_mm_prefetch((const char*)block(hash[i]), _MM_HINT_T0);
+#endif
+		for (size_t i = 0; i < n; ++i) {
+#ifdef __SSE2__
+			if (i + PREFETCH_DISTANCE < n)
+				_mm_prefetch((const char*)block(hash[i + PREFETCH_DISTANCE]), _MM_HINT_T0);
+#endif
+			out[i] = contains(hash[i]);
+		}
+	}
+
+	size_t bytes() const
+	{
+		return blocks_ * BLOCK_WORDS * sizeof(uint32_t);
+	}
+
+private:
+
+	enum { BLOCK_WORDS = 8, CACHE_LINE_WORDS = 16, PREFETCH_DISTANCE = 16 };
+
+	// Odd multipliers that derive the bit of each word from the lower half of the hash.
+	static const uint32_t* salt()
+	{
+		static const uint32_t s[BLOCK_WORDS] = { 0x47b6137bu, 0x44974d91u, 0x8824ad5bu, 0xa2b7289du, 0x705495c7u, 0x2df1424bu, 0x9efc4947u, 0x5c6bfb31u };
+		return s;
+	}
+
+	uint32_t* block(uint64_t hash)
+	{
+		return data_ + (((hash >> 32) * blocks_) >> 32) * BLOCK_WORDS;
+	}
+
+	const uint32_t* block(uint64_t hash) const
+	{
+		return data_ + (((hash >> 32) * blocks_) >> 32) * BLOCK_WORDS;
+	}
+
+	BlockedBloomFilter(const BlockedBloomFilter&) = delete;
+	BlockedBloomFilter& operator=(const BlockedBloomFilter&) = delete;
+
+	const size_t blocks_;
+	uint32_t *mem_, *data_;
+
+};
+
+#endif
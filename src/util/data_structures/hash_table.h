@@ -21,6 +21,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <stdexcept>
 #include <stdlib.h>
+#include "../system/huge_pages.h"
 
 template<typename _K, typename _V, typename _HashFunction>
 struct HashTable : private _HashFunction
@@ -40,6 +41,7 @@ struct HashTable : private _HashFunction
 		table((Entry*)calloc(size, sizeof(Entry))),
 		size_(size)
 	{
+		HugePages::advise(table, size * sizeof(Entry));
 	}
 
 	~HashTable()
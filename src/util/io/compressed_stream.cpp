@@ -16,101 +16,320 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ****/
 
+#include <algorithm>
 #include <stdexcept>
 #include "compressed_stream.h"
 
-void ZlibSource::init()
+ZlibSink::ZlibSink(StreamEntity *prev):
+	StreamEntity(prev)
 {
-	eos_ = false;
 	strm.zalloc = Z_NULL;
 	strm.zfree = Z_NULL;
 	strm.opaque = Z_NULL;
-	strm.avail_in = 0;
-	strm.next_in = Z_NULL;
-	int ret = inflateInit2(&strm, 15 + 32);
-	if (ret != Z_OK)
-		throw std::runtime_error("Error opening compressed file (inflateInit): " + file_name());
+	if (deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		throw std::runtime_error("deflateInit error");
 }
 
-ZlibSource::ZlibSource(StreamEntity *prev):
-	StreamEntity(prev)
+void ZlibSink::deflate_loop(const char *ptr, size_t count, int flush)
 {
-	init();
+	strm.avail_in = (uInt)count;
+	strm.next_in = (Bytef*)ptr;
+	do {
+		pair<char*, char*> out = prev_->write_buffer();
+		const size_t chunk_size = out.second - out.first;
+		strm.avail_out = (uInt)chunk_size;
+		strm.next_out = (Bytef*)out.first;
+		if (deflate(&strm, flush) == Z_STREAM_ERROR)
+			throw std::runtime_error("deflate error");
+		prev_->flush(chunk_size - strm.avail_out);
+	} while (strm.avail_out == 0);
 }
 
-size_t ZlibSource::read(char *ptr, size_t count)
+void ZlibSink::write(const char * ptr, size_t count)
 {
-	strm.avail_out = (uInt)count;
-	strm.next_out = (Bytef*)ptr;
-	while (strm.avail_out > 0 && !eos_) {
-		if (strm.avail_in == 0) {
-			pair<const char*, const char*> in = prev_->read();
+	deflate_loop(ptr, count, Z_NO_FLUSH);
+}
 
-			strm.avail_in = (uInt)(in.second - in.first);
-			if (strm.avail_in == 0) {
-				eos_ = true;
-				break;
-			}
-			strm.next_in = (Bytef*)in.first;
-		}
+void ZlibSink::close()
+{
+	deflate_loop(0, 0, Z_FINISH);
+	deflateEnd(&strm);
+	prev_->close();
+}
 
-		int ret = inflate(&strm, Z_NO_FLUSH);
-		if (ret == Z_STREAM_END) {
-			int ret = inflateInit2(&strm, 15 + 32);
-			if (ret != Z_OK)
-				throw std::runtime_error("Error initializing compressed stream (inflateInit): " + file_name());
-		}
-		else if (ret != Z_OK)
-			throw std::runtime_error("Inflate error.");
+ParallelZlibSource::ParallelZlibSource(StreamEntity *prev, unsigned threads):
+	StreamEntity(prev),
+	threads_(std::max(threads, 1u)),
+	max_batches_(2 * threads_ + 2)
+{
+	start();
+}
+
+ParallelZlibSource::~ParallelZlibSource()
+{
+	stop();
+}
+
+void ParallelZlibSource::start()
+{
+	buf_.clear();
+	pos_ = 0;
+	batches_.clear();
+	pending_.clear();
+	current_.reset();
+	stop_ = false;
+	eof_ = false;
+	error_ = nullptr;
+	workers_.emplace_back(&ParallelZlibSource::read_loop, this);
+	for (unsigned i = 0; i < threads_; ++i)
+		workers_.emplace_back(&ParallelZlibSource::inflate_loop, this);
+}
+
+void ParallelZlibSource::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mtx_);
+		stop_ = true;
 	}
-	return count - strm.avail_out;
+	cond_.notify_all();
+	for (std::thread &t : workers_)
+		t.join();
+	workers_.clear();
 }
 
-void ZlibSource::close()
+void ParallelZlibSource::close()
 {
-	inflateEnd(&strm);
+	stop();
 	prev_->close();
 }
 
-void ZlibSource::rewind()
+void ParallelZlibSource::rewind()
 {
+	stop();
 	prev_->rewind();
-	init();
+	start();
 }
 
-ZlibSink::ZlibSink(StreamEntity *prev):
-	StreamEntity(prev)
+pair<const char*, const char*> ParallelZlibSource::read()
+{
+	std::unique_lock<std::mutex> lock(mtx_);
+	current_.reset();
+	while (true) {
+		cond_.wait(lock, [this] { return error_ || (!batches_.empty() && batches_.front()->done) || (batches_.empty() && eof_); });
+		if (error_)
+			std::rethrow_exception(error_);
+		if (batches_.empty())
+			return pair<const char*, const char*>(nullptr, nullptr);
+		current_ = std::move(batches_.front());
+		batches_.pop_front();
+		cond_.notify_all();
+		if (!current_->out.empty())
+			return pair<const char*, const char*>(current_->out.data(), current_->out.data() + current_->out.size());
+	}
+}
+
+// Makes n bytes of compressed input available at pos_. Returns false at the end of the input.
+bool ParallelZlibSource::fetch(size_t n)
 {
+	while (buf_.size() - pos_ < n) {
+		const pair<const char*, const char*> in = prev_->read();
+		if (in.first == in.second)
+			return false;
+		if (pos_ > 0) {
+			buf_.erase(buf_.begin(), buf_.begin() + pos_);
+			pos_ = 0;
+		}
+		buf_.insert(buf_.end(), in.first, in.second);
+	}
+	return true;
+}
+
+// Returns the compressed size of the BGZF block at pos_, or 0 if the input does
+// not continue with a complete BGZF block.
+size_t ParallelZlibSource::bgzf_block_size()
+{
+	if (!fetch(12))
+		return 0;
+	const unsigned char *h = (const unsigned char*)buf_.data() + pos_;
+	if (h[0] != 0x1F || h[1] != 0x8B || h[2] != 8 || (h[3] & 4) == 0)
+		return 0;
+	const size_t xlen = h[10] | (h[11] << 8);
+	if (!fetch(12 + xlen))
+		return 0;
+	h = (const unsigned char*)buf_.data() + pos_;
+	for (size_t i = 12; i + 4 <= 12 + xlen; i += 4 + (h[i + 2] | (h[i + 3] << 8))) {
+		if (h[i] != 'B' || h[i + 1] != 'C' || (h[i + 2] | (h[i + 3] << 8)) != 2 || i + 6 > 12 + xlen)
+			continue;
+		const size_t size = (h[i + 4] | (h[i + 5] << 8)) + 1;
+		return size >= 12 + xlen + 8 && fetch(size) ? size : 0;
+	}
+	return 0;
+}
+
+// Appends a batch to the output, waiting while too many batches are queued.
+// Returns false if the source is stopped.
+bool ParallelZlibSource::push(std::unique_ptr<Batch> &batch)
+{
+	std::unique_lock<std::mutex> lock(mtx_);
+	cond_.wait(lock, [this] { return stop_ || batches_.size() < max_batches_; });
+	if (stop_)
+		return false;
+	if (!batch->done)
+		pending_.push_back(batch.get());
+	batches_.push_back(std::move(batch));
+	cond_.notify_all();
+	return true;
+}
+
+void ParallelZlibSource::inflate_serial()
+{
+	z_stream strm;
 	strm.zalloc = Z_NULL;
 	strm.zfree = Z_NULL;
 	strm.opaque = Z_NULL;
-	if (deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
-		throw std::runtime_error("deflateInit error");
+	strm.avail_in = (uInt)(buf_.size() - pos_);
+	strm.next_in = (Bytef*)buf_.data() + pos_;
+	if (inflateInit2(&strm, 15 + 32) != Z_OK)
+		throw std::runtime_error("Error opening compressed file (inflateInit): " + file_name());
+	std::unique_ptr<Batch> batch;
+	try {
+		while (true) {
+			if (!batch) {
+				batch.reset(new Batch);
+				batch->done = true;
+				batch->out.resize(batch_size);
+				strm.avail_out = (uInt)batch_size;
+				strm.next_out = (Bytef*)batch->out.data();
+			}
+			if (strm.avail_in == 0) {
+				const pair<const char*, const char*> in = prev_->read();
+				if (in.first == in.second)
+					break;
+				strm.avail_in = (uInt)(in.second - in.first);
+				strm.next_in = (Bytef*)in.first;
+			}
+			const int ret = inflate(&strm, Z_NO_FLUSH);
+			if (ret == Z_STREAM_END)
+				inflateReset(&strm);
+			else if (ret != Z_OK)
+				throw std::runtime_error("Inflate error.");
+			if (strm.avail_out == 0 && !push(batch))
+				break;
+		}
+	}
+	catch (...) {
+		inflateEnd(&strm);
+		throw;
+	}
+	inflateEnd(&strm);
+	if (batch) {
+		batch->out.resize(batch_size - strm.avail_out);
+		push(batch);
+	}
 }
 
-void ZlibSink::deflate_loop(const char *ptr, size_t count, int flush)
+void ParallelZlibSource::read_loop()
 {
-	strm.avail_in = (uInt)count;
-	strm.next_in = (Bytef*)ptr;
-	do {
-		pair<char*, char*> out = prev_->write_buffer();
-		const size_t chunk_size = out.second - out.first;
-		strm.avail_out = (uInt)chunk_size;
-		strm.next_out = (Bytef*)out.first;
-		if (deflate(&strm, flush) == Z_STREAM_ERROR)
-			throw std::runtime_error("deflate error");
-		prev_->flush(chunk_size - strm.avail_out);
-	} while (strm.avail_out == 0);
+	try {
+		std::unique_ptr<Batch> batch;
+		size_t block_size;
+		bool running = true;
+		while (running && (block_size = bgzf_block_size()) != 0) {
+			if (!batch) {
+				batch.reset(new Batch);
+				batch->done = false;
+			}
+			const char *block = buf_.data() + pos_;
+			batch->in.insert(batch->in.end(), block, block + block_size);
+			pos_ += block_size;
+			if (batch->in.size() >= batch_size)
+				running = push(batch);
+		}
+		if (running && batch)
+			running = push(batch);
+		if (running)
+			inflate_serial();
+	}
+	catch (...) {
+		std::lock_guard<std::mutex> lock(mtx_);
+		error_ = std::current_exception();
+	}
+	{
+		std::lock_guard<std::mutex> lock(mtx_);
+		eof_ = true;
+	}
+	cond_.notify_all();
 }
 
-void ZlibSink::write(const char * ptr, size_t count)
+void ParallelZlibSource::inflate_loop()
 {
-	deflate_loop(ptr, count, Z_NO_FLUSH);
+	while (true) {
+		Batch *batch;
+		{
+			std::unique_lock<std::mutex> lock(mtx_);
+			cond_.wait(lock, [this] { return stop_ || eof_ || !pending_.empty(); });
+			if (stop_ || pending_.empty())
+				return;
+			batch = pending_.front();
+			pending_.pop_front();
+		}
+		try {
+			inflate_batch(*batch);
+		}
+		catch (...) {
+			std::lock_guard<std::mutex> lock(mtx_);
+			if (!error_)
+				error_ = std::current_exception();
+		}
+		{
+			std::lock_guard<std::mutex> lock(mtx_);
+			batch->done = true;
+		}
+		cond_.notify_all();
+	}
 }
 
-void ZlibSink::close()
+// Inflates the complete gzip members of a batch. The output size is the sum of
+// the uncompressed sizes stored in the member trailers.
+void ParallelZlibSource::inflate_batch(Batch &batch)
 {
-	deflate_loop(0, 0, Z_FINISH);
-	deflateEnd(&strm);
-	prev_->close();
-}
\ No newline at end of file
+	size_t out_size = 0;
+	for (size_t i = 0; i < batch.in.size(); ) {
+		const unsigned char *h = (const unsigned char*)batch.in.data() + i;
+		const size_t xlen = h[10] | (h[11] << 8);
+		size_t block_size = 0;
+		for (size_t j = 12; j + 6 <= 12 + xlen; j += 4 + (h[j + 2] | (h[j + 3] << 8)))
+			if (h[j] == 'B' && h[j + 1] == 'C')
+				block_size = (h[j + 4] | (h[j + 5] << 8)) + 1;
+		const unsigned char *isize = h + block_size - 4;
+		out_size += (size_t)isize[0] | ((size_t)isize[1] << 8) | ((size_t)isize[2] << 16) | ((size_t)isize[3] << 24);
+		i += block_size;
+	}
+	batch.out.resize(out_size + 1);
+
+	z_stream strm;
+	strm.zalloc = Z_NULL;
+	strm.zfree = Z_NULL;
+	strm.opaque = Z_NULL;
+	strm.avail_in = (uInt)batch.in.size();
+	strm.next_in = (Bytef*)batch.in.data();
+	strm.avail_out = (uInt)batch.out.size();
+	strm.next_out = (Bytef*)batch.out.data();
+	if (inflateInit2(&strm, 15 + 16) != Z_OK)
+		throw std::runtime_error("Error initializing compressed stream (inflateInit).");
+	int ret = Z_STREAM_END;
+	while (strm.avail_in > 0) {
+		ret = inflate(&strm, Z_NO_FLUSH);
+		if (ret == Z_STREAM_END)
+			inflateReset(&strm);
+		else if (ret != Z_OK)
+			break;
+	}
+	inflateEnd(&strm);
+	// The output buffer has one spare byte, so that empty batches have a valid output pointer.
+	if (ret != Z_STREAM_END || strm.avail_out != 1)
+		throw std::runtime_error("Inflate error.");
+	batch.out.pop_back();
+	batch.in.clear();
+	batch.in.shrink_to_fit();
+}
@@ -20,23 +20,60 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define COMPRESSED_STREAM_H_
 
 #include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
 #include <zlib.h>
 #include "stream_entity.h"
 #include "../util.h"
 
 using std::string;
 
-struct ZlibSource : public StreamEntity
+// Inflates gzip input on background threads, so that parsing does not wait for
+// inflate. The members of BGZF files, which record their compressed size, are
+// grouped into batches that are inflated in parallel. Other streams are inflated
+// serially on the reader thread.
+struct ParallelZlibSource : public StreamEntity
 {
-	ZlibSource(StreamEntity *prev);
-	virtual size_t read(char *ptr, size_t count);
+	ParallelZlibSource(StreamEntity *prev, unsigned threads);
+	virtual pair<const char*, const char*> read();
 	virtual void close();
 	virtual void rewind();
+	virtual ~ParallelZlibSource();
 private:
-	void init();
-	z_stream strm;
-	static const size_t chunk_size = 1llu << 20;
-	bool eos_;
+	struct Batch
+	{
+		std::vector<char> in, out;
+		bool done;
+	};
+	void start();
+	void stop();
+	bool fetch(size_t n);
+	size_t bgzf_block_size();
+	bool push(std::unique_ptr<Batch> &batch);
+	void inflate_serial();
+	void read_loop();
+	void inflate_loop();
+	static void inflate_batch(Batch &batch);
+
+	// Compressed bytes per batch of BGZF blocks and uncompressed bytes per batch of a serial stream.
+	static const size_t batch_size = 1llu << 20;
+	const unsigned threads_;
+	const size_t max_batches_;
+	std::vector<char> buf_;
+	size_t pos_;
+	std::deque<std::unique_ptr<Batch>> batches_;
+	std::deque<Batch*> pending_;
+	std::unique_ptr<Batch> current_;
+	bool stop_, eof_;
+	std::exception_ptr error_;
+	std::mutex mtx_;
+	std::condition_variable cond_;
+	std::vector<std::thread> workers_;
 };
 
 struct ZlibSink : public StreamEntity
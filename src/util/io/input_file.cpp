@@ -63,7 +63,7 @@ InputFile::InputFile(const string &file_name, int flags) :
 	if (n >= 1)
 		source->putback(b[0]);
 	if (n == 2 && is_gzip_stream((const unsigned char*)b))
-		buffer_ = new InputStreamBuffer(new ZlibSource(buffer_));
+		buffer_ = new ParallelZlibSource(buffer_, config.threads_);
 }
 
 InputFile::InputFile(TempFile &tmp_file, int flags) :
@@ -74,6 +74,13 @@ InputFile::InputFile(TempFile &tmp_file, int flags) :
 	tmp_file.rewind();
 }
 
+InputFile::InputFile(const string &file_name, FILE *file) :
+	Deserializer(new InputStreamBuffer(new FileSource(file_name, file))),
+	file_name(file_name),
+	unlinked(false)
+{
+}
+
 void InputFile::close_and_delete()
 {
 	close();
@@ -38,6 +38,7 @@ struct InputFile : public Deserializer
 
 	InputFile(const string &file_name, int flags = 0);
 	InputFile(TempFile &tmp_file, int flags = 0);
+	InputFile(const string &file_name, FILE *file);
 	void close_and_delete();
 	
 	string file_name;
@@ -0,0 +1,115 @@
+/****
+DIAMOND protein aligner
+Copyright (C) 2013-2019 Benjamin Buchfink <buchfink@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+****/
+
+#ifndef _MSC_VER
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <stdexcept>
+#include "mapped_file.h"
+
+using std::string;
+using std::runtime_error;
+
+#ifdef _MSC_VER
+
+MappedFile::MappedFile(FILE *file, const string &file_name):
+	file_name_(file_name)
+{
+	throw runtime_error("Memory mapped database files are not supported on this platform.");
+}
+
+MappedFile::MappedFile(const string &file_name):
+	file_name_(file_name)
+{
+	throw runtime_error("Memory mapped files are not supported on this platform.");
+}
+
+MappedFile::~MappedFile()
+{}
+
+void MappedFile::prefetch(size_t offset, size_t n) const
+{}
+
+void MappedFile::release(size_t offset, size_t n)
+{}
+
+#else
+
+static char* map_file(int fd, size_t &size, const string &file_name)
+{
+	struct stat buf;
+	if (fstat(fd, &buf) < 0) {
+		perror(0);
+		throw runtime_error("Error calling fstat on file " + file_name);
+	}
+	size = (size_t)buf.st_size;
+	void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	if (p == MAP_FAILED) {
+		perror(0);
+		throw runtime_error("Error calling mmap on file " + file_name);
+	}
+	return (char*)p;
+}
+
+MappedFile::MappedFile(FILE *file, const string &file_name):
+	file_name_(file_name)
+{
+	ptr_ = map_file(fileno(file), size_, file_name);
+}
+
+MappedFile::MappedFile(const string &file_name):
+	file_name_(file_name)
+{
+	FILE *f = fopen(file_name.c_str(), "rb");
+	if (f == nullptr) {
+		perror(0);
+		throw runtime_error("Error opening file " + file_name);
+	}
+	try {
+		ptr_ = map_file(fileno(f), size_, file_name);
+	}
+	catch (...) {
+		fclose(f);
+		throw;
+	}
+	fclose(f);
+}
+
+MappedFile::~MappedFile()
+{
+	munmap(ptr_, size_);
+}
+
+void MappedFile::prefetch(size_t offset, size_t n) const
+{
+	static const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+	const size_t begin = offset / page_size * page_size;
+	madvise(ptr_ + begin, std::min(offset + n, size_) - begin, MADV_WILLNEED);
+}
+
+void MappedFile::release(size_t offset, size_t n)
+{
+	static const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+	const size_t begin = offset / page_size * page_size;
+	madvise(ptr_ + begin, std::min(offset + n, size_) - begin, MADV_DONTNEED);
+}
+
+#endif
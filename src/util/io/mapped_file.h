@@ -0,0 +1,62 @@
+/****
+DIAMOND protein aligner
+Copyright (C) 2013-2019 Benjamin Buchfink <buchfink@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+****/
+
+#ifndef MAPPED_FILE_H_
+#define MAPPED_FILE_H_
+
+#include <stdio.h>
+#include <string>
+
+// Read-only file mapping with private copy-on-write semantics. Pages that are
+// never written stay shared with the page cache and with other processes
+// mapping the same file.
+struct MappedFile
+{
+
+	MappedFile(FILE *file, const std::string &file_name);
+	MappedFile(const std::string &file_name);
+	~MappedFile();
+	void prefetch(size_t offset, size_t n) const;
+	// Discards private copies of written pages in the range, so that they are
+	// read back from the file on the next access.
+	void release(size_t offset, size_t n);
+
+	char* data(size_t offset = 0)
+	{
+		return ptr_ + offset;
+	}
+
+	const char* data(size_t offset = 0) const
+	{
+		return ptr_ + offset;
+	}
+
+	size_t size() const
+	{
+		return size_;
+	}
+
+private:
+
+	char *ptr_;
+	size_t size_;
+	const std::string file_name_;
+
+};
+
+#endif
@@ -16,11 +16,25 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ****/
 
+#include <string.h>
+#include <algorithm>
 #include "text_input_file.h"
 
 TextInputFile::TextInputFile(const string &file_name) :
 	InputFile(file_name),
 	line_count(0),
+	line_buf_(line_buf_size),
+	line_buf_used_(0),
+	line_buf_end_(0),
+	putback_line_(false),
+	eof_(false)
+{
+}
+
+TextInputFile::TextInputFile(const string &file_name, FILE *file) :
+	InputFile(file_name, file),
+	line_count(0),
+	line_buf_(line_buf_size),
 	line_buf_used_(0),
 	line_buf_end_(0),
 	putback_line_(false),
@@ -53,10 +67,10 @@ void TextInputFile::getline()
 	}
 	line.clear();
 	while (true) {
-		const char *p = (const char*)memchr(&line_buf_[line_buf_used_], '\n', line_buf_end_ - line_buf_used_);
+		const char *p = (const char*)memchr(line_buf_.data() + line_buf_used_, '\n', line_buf_end_ - line_buf_used_);
 		if (p == 0) {
-			line.append(&line_buf_[line_buf_used_], line_buf_end_ - line_buf_used_);
-			line_buf_end_ = read(line_buf_, line_buf_size);
+			line.append(line_buf_.data() + line_buf_used_, line_buf_end_ - line_buf_used_);
+			line_buf_end_ = read(line_buf_.data(), line_buf_size);
 			line_buf_used_ = 0;
 			if (line_buf_end_ == 0) {
 				eof_ = true;
@@ -65,8 +79,8 @@ void TextInputFile::getline()
 			}
 		}
 		else {
-			const size_t n = (p - line_buf_) - line_buf_used_;
-			line.append(&line_buf_[line_buf_used_], n);
+			const size_t n = (p - line_buf_.data()) - line_buf_used_;
+			line.append(line_buf_.data() + line_buf_used_, n);
 			line_buf_used_ += n + 1;
 			const size_t s = line.length() - 1;
 			if (!line.empty() && line[s] == '\r')
@@ -82,3 +96,38 @@ void TextInputFile::putback_line()
 	putback_line_ = true;
 	--line_count;
 }
+
+size_t TextInputFile::fill(size_t min_size)
+{
+	size_t avail = line_buf_end_ - line_buf_used_;
+	if (!putback_line_ && avail >= min_size)
+		return avail;
+	const size_t putback = putback_line_ ? line.length() + 1 : 0;
+	if (putback_line_ || line_buf_.size() < min_size) {
+		vector<char> buf(std::max(min_size, putback + avail));
+		std::copy(line.begin(), line.begin() + (putback ? line.length() : 0), buf.begin());
+		if (putback)
+			buf[line.length()] = '\n';
+		std::copy(line_buf_.begin() + line_buf_used_, line_buf_.begin() + line_buf_end_, buf.begin() + putback);
+		line_buf_.swap(buf);
+		if (putback_line_) {
+			putback_line_ = false;
+			line.clear();
+		}
+	}
+	else
+		memmove(line_buf_.data(), line_buf_.data() + line_buf_used_, avail);
+	avail += putback;
+	size_t n;
+	while (avail < line_buf_.size() && (n = read(line_buf_.data() + avail, line_buf_.size() - avail)) > 0)
+		avail += n;
+	line_buf_used_ = 0;
+	line_buf_end_ = avail;
+	return avail;
+}
+
+void TextInputFile::consume(size_t n, size_t lines)
+{
+	line_buf_used_ += n;
+	line_count += lines;
+}
@@ -31,11 +31,24 @@ using std::runtime_error;
 struct TextInputFile : public InputFile
 {
 	TextInputFile(const string &file_name);
+	// Reads from an open stream, which is closed with the file.
+	TextInputFile(const string &file_name, FILE *file);
 	void rewind();
 	bool eof() const;
 	void putback(char c);
 	void getline();
 	void putback_line();
+	// Block access for parsers that process many lines at once. Makes at least
+	// min_size bytes available at buffer() unless the end of the file is reached
+	// first, and returns the number of available bytes. A line that was put back
+	// is returned to the buffer.
+	size_t fill(size_t min_size);
+	const char* buffer() const
+	{
+		return line_buf_.data() + line_buf_used_;
+	}
+	// Removes n bytes that hold the given number of lines from the buffer.
+	void consume(size_t n, size_t lines);
 	operator bool() const {
 		return !eof();
 	}
@@ -47,7 +60,7 @@ protected:
 
 	enum { line_buf_size = 256 };
 
-	char line_buf_[line_buf_size];
+	vector<char> line_buf_;
 	size_t line_buf_used_, line_buf_end_;
 	bool putback_line_, eof_;
 
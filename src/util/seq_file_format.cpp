@@ -16,6 +16,8 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ****/
 
+#include <string.h>
+#include <thread>
 #include "seq_file_format.h"
 
 struct Raw_text {};
@@ -101,6 +103,113 @@ bool FASTQ_format::get_seq(vector<char>& id, vector<Letter>& seq, TextInputFile
 	return true;
 }
 
+// Skips lines that are empty apart from a carriage return.
+static const char* skip_empty_lines(const char *p, const char *end)
+{
+	while (p < end) {
+		if (*p == '\n')
+			++p;
+		else if (*p == '\r' && p + 1 < end && p[1] == '\n')
+			p += 2;
+		else
+			break;
+	}
+	return p;
+}
+
+// Advances p past the next line break and sets line_end to the end of the line
+// without a carriage return. Returns false if there is no line break before end.
+static bool next_line(const char *&p, const char *end, const char *&line_end)
+{
+	const char *eol = (const char*)memchr(p, '\n', end - p);
+	if (eol == nullptr)
+		return false;
+	line_end = eol > p && eol[-1] == '\r' ? eol - 1 : eol;
+	p = eol + 1;
+	return true;
+}
+
+static bool next_nonempty_line(const char *&p, const char *end, const char *&line, const char *&line_end, size_t &lines)
+{
+	do {
+		line = p;
+		if (!next_line(p, end, line_end))
+			return false;
+		++lines;
+	} while (line == line_end);
+	return true;
+}
+
+static bool convert_line(const char *line, const char *line_end, vector<Letter> &seq)
+{
+	const size_t n = seq.size();
+	seq.resize(n + (line_end - line));
+	return input_value_traits.from_char.convert(line, line_end, seq.data() + n);
+}
+
+const char* FASTA_format::record_end(const char *begin, const char *end, bool eof) const
+{
+	const char *p = skip_empty_lines(begin, end);
+	if (p == end)
+		return nullptr;
+	for (const char *q = p + 1; q < end && (q = (const char*)memchr(q, '>', end - q)) != nullptr; ++q)
+		if (q[-1] == '\n')
+			return q;
+	return eof ? end : nullptr;
+}
+
+bool FASTA_format::parse_record(const char *begin, const char *end, vector<char> &id, vector<Letter> &seq, vector<char> *qual, size_t &lines) const
+{
+	const char *p = begin, *line, *line_end;
+	if (!next_nonempty_line(p, end, line, line_end, lines) || *line != '>')
+		return false;
+	id.insert(id.end(), line + 1, line_end);
+	while (p < end) {
+		line = p;
+		if (!next_line(p, end, line_end))
+			return false;
+		++lines;
+		if (!convert_line(line, line_end, seq))
+			return false;
+	}
+	return true;
+}
+
+const char* FASTQ_format::record_end(const char *begin, const char *end, bool eof) const
+{
+	const char *p = skip_empty_lines(begin, end);
+	if (p == end)
+		return nullptr;
+	for (int i = 0; i < 4; ++i) {
+		const char *eol = (const char*)memchr(p, '\n', end - p);
+		if (eol == nullptr)
+			return eof ? end : nullptr;
+		p = eol + 1;
+	}
+	return p;
+}
+
+bool FASTQ_format::parse_record(const char *begin, const char *end, vector<char> &id, vector<Letter> &seq, vector<char> *qual, size_t &lines) const
+{
+	const char *p = begin, *line, *line_end;
+	if (!next_nonempty_line(p, end, line, line_end, lines) || *line != '@')
+		return false;
+	id.insert(id.end(), line + 1, line_end);
+	line = p;
+	if (!next_line(p, end, line_end) || !convert_line(line, line_end, seq))
+		return false;
+	line = p;
+	if (!next_line(p, end, line_end) || line == line_end || *line != '+')
+		return false;
+	line = p;
+	if (!next_line(p, end, line_end))
+		return false;
+	if (qual)
+		qual->insert(qual->end(), line, line_end);
+	lines += 3;
+	return true;
+}
+
 const Sequence_file_format * guess_format(TextInputFile &file)
 {
 	static const FASTA_format fasta;
@@ -117,3 +226,96 @@ const Sequence_file_format * guess_format(TextInputFile &file)
 	}
 	return 0;
 }
+
+SeqBlockParser::SeqBlockParser(const Sequence_file_format &format, unsigned threads):
+	format_(format),
+	threads_(threads),
+	block_size_(BLOCK_SIZE)
+{}
+
+size_t SeqBlockParser::parse(TextInputFile &file)
+{
+	record_begin_.assign(1, 0);
+	const char *buf;
+	while (true) {
+		const size_t avail = file.fill(block_size_);
+		const bool eof = avail < block_size_;
+		buf = file.buffer();
+		const char *end = buf + avail, *p = buf, *q;
+		while (p < end && (q = format_.record_end(p, end, eof)) != nullptr) {
+			record_begin_.push_back(q - buf);
+			p = q;
+		}
+		if (record_begin_.size() > 1 || eof)
+			break;
+		block_size_ *= 2;
+	}
+
+	const size_t n = record_begin_.size() - 1, parts = std::min((size_t)threads_, n);
+	part_begin_.clear();
+	for (size_t i = 0; i < parts; ++i)
+		part_begin_.push_back(std::lower_bound(record_begin_.begin(), record_begin_.end() - 1, record_begin_.back() / parts * i) - record_begin_.begin());
+	part_begin_.push_back(n);
+	parts_.resize(parts);
+	vector<std::thread> threads;
+	for (size_t i = 0; i < parts; ++i)
+		if (i + 1 < parts)
+			threads.emplace_back(&SeqBlockParser::parse_part, this, &parts_[i], part_begin_[i], part_begin_[i + 1], buf);
+		else
+			parse_part(&parts_[i], part_begin_[i], part_begin_[i + 1], buf);
+	for (std::thread &t : threads)
+		t.join();
+	return n;
+}
+
+void SeqBlockParser::parse_part(Part *part, size_t begin, size_t end, const char *buf) const
+{
+	part->ids.clear();
+	part->seqs.clear();
+	part->quals.clear();
+	part->id_end.assign(1, 0);
+	part->seq_end.assign(1, 0);
+	part->qual_end.assign(1, 0);
+	part->lines.clear();
+	part->valid = end - begin;
+	for (size_t i = begin; i < end; ++i) {
+		size_t lines = 0;
+		if (!format_.parse_record(buf + record_begin_[i], buf + record_begin_[i + 1], part->ids, part->seqs, &part->quals, lines)) {
+			part->valid = i - begin;
+			return;
+		}
+		part->id_end.push_back(part->ids.size());
+		part->seq_end.push_back(part->seqs.size());
+		part->qual_end.push_back(part->quals.size());
+		part->lines.push_back(lines);
+	}
+}
+
+sequence SeqBlockParser::id(size_t i) const
+{
+	const Part &p = parts_[part(i)];
+	const size_t j = local(i);
+	return sequence(p.ids.data() + p.id_end[j], p.id_end[j + 1] - p.id_end[j]);
+}
+
+sequence SeqBlockParser::seq(size_t i) const
+{
+	const Part &p = parts_[part(i)];
+	const size_t j = local(i);
+	return sequence(p.seqs.data() + p.seq_end[j], p.seq_end[j + 1] - p.seq_end[j]);
+}
+
+sequence SeqBlockParser::qual(size_t i) const
+{
+	const Part &p = parts_[part(i)];
+	const size_t j = local(i);
+	return sequence(p.quals.data() + p.qual_end[j], p.qual_end[j + 1] - p.qual_end[j]);
+}
+
+void SeqBlockParser::consume(TextInputFile &file, size_t n) const
+{
+	size_t lines = 0;
+	for (size_t i = 0; i < n; ++i)
+		lines += parts_[part(i)].lines[local(i)];
+	file.consume(record_begin_[n], lines);
+}
@@ -20,7 +20,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define SEQ_FILE_FORMAT_H_
 
 #include <vector>
+#include <algorithm>
 #include "../basic/value.h"
+#include "../basic/sequence.h"
 #include "io/text_input_file.h"
 
 using std::vector;
@@ -38,6 +40,19 @@ struct Sequence_file_format
 {
 
 	virtual bool get_seq(vector<char> &id, vector<Letter> &seq, TextInputFile &s, vector<char> *qual = nullptr) const = 0;
+	// Returns the end of the record that starts at begin, including any empty lines
+	// before it, or nullptr if the record is not complete within [begin, end).
+	virtual const char* record_end(const char *begin, const char *end, bool eof) const
+	{
+		return nullptr;
+	}
+	// Appends the id, sequence and quality of a complete record to the buffers and
+	// adds the number of lines to lines. Returns false if the record has to be read
+	// by get_seq instead, which reports format errors.
+	virtual bool parse_record(const char *begin, const char *end, vector<char> &id, vector<Letter> &seq, vector<char> *qual, size_t &lines) const
+	{
+		return false;
+	}
 	virtual ~Sequence_file_format()
 	{ }
 	
@@ -51,6 +66,9 @@ struct FASTA_format : public Sequence_file_format
 
 	virtual bool get_seq(vector<char> &id, vector<Letter> &seq, TextInputFile &s, vector<char> *qual = nullptr) const;
 
+	virtual const char* record_end(const char *begin, const char *end, bool eof) const;
+	virtual bool parse_record(const char *begin, const char *end, vector<char> &id, vector<Letter> &seq, vector<char> *qual, size_t &lines) const;
+
 	virtual ~FASTA_format()
 	{ }
 
@@ -64,6 +82,9 @@ struct FASTQ_format : public Sequence_file_format
 
 	virtual bool get_seq(vector<char> &id, vector<Letter> &seq, TextInputFile &s, vector<char> *qual = nullptr) const;
 
+	virtual const char* record_end(const char *begin, const char *end, bool eof) const;
+	virtual bool parse_record(const char *begin, const char *end, vector<char> &id, vector<Letter> &seq, vector<char> *qual, size_t &lines) const;
+
 	virtual ~FASTQ_format()
 	{ }
 
@@ -71,4 +92,56 @@ struct FASTQ_format : public Sequence_file_format
 
 const Sequence_file_format* guess_format(TextInputFile &file);
 
+// Parses the records at the start of the input buffer on several threads. The
+// record boundaries are found by scanning for line breaks and record markers,
+// then the records are validated and encoded in parallel.
+struct SeqBlockParser
+{
+
+	SeqBlockParser(const Sequence_file_format &format, unsigned threads);
+	// Parses the complete records in the next block of the input. Returns the
+	// number of records.
+	size_t parse(TextInputFile &file);
+	// Returns false if the record could not be parsed and has to be read by get_seq.
+	bool valid(size_t i) const
+	{
+		return local(i) < parts_[part(i)].valid;
+	}
+	sequence id(size_t i) const;
+	sequence seq(size_t i) const;
+	sequence qual(size_t i) const;
+	// Removes the first n records from the input buffer.
+	void consume(TextInputFile &file, size_t n) const;
+
+	enum { BLOCK_SIZE = 1 << 26 };
+
+private:
+
+	struct Part
+	{
+		size_t begin, valid;
+		vector<char> ids, quals;
+		vector<Letter> seqs;
+		vector<size_t> id_end, seq_end, qual_end, lines;
+	};
+
+	void parse_part(Part *part, size_t begin, size_t end, const char *buf) const;
+	size_t part(size_t i) const
+	{
+		return std::upper_bound(part_begin_.begin(), part_begin_.end(), i) - part_begin_.begin() - 1;
+	}
+	size_t local(size_t i) const
+	{
+		return i - part_begin_[part(i)];
+	}
+
+	const Sequence_file_format &format_;
+	const unsigned threads_;
+	size_t block_size_;
+	// Start offsets of the records in the buffer, followed by the end of the last record.
+	vector<size_t> record_begin_, part_begin_;
+	vector<Part> parts_;
+
+};
+
 #endif /* SEQ_FILE_FORMAT_H_ */
\ No newline at end of file
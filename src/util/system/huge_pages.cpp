@@ -0,0 +1,94 @@
+/****
+DIAMOND protein aligner
+Copyright (C) 2013-2019 Benjamin Buchfink <buchfink@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+****/
+
+#include <string.h>
+#include "huge_pages.h"
+#include "../../basic/config.h"
+#include "../log_stream.h"
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+namespace HugePages {
+
+static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+void advise(void *ptr, size_t size)
+{
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+	if (!config.huge_pages)
+		return;
+	const size_t begin = ((size_t)ptr + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE,
+		end = ((size_t)ptr + size) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+	if (end > begin)
+		madvise((void*)begin, end - begin, MADV_HUGEPAGE);
+#endif
+}
+
+}
+
+DtlbMissCounter::DtlbMissCounter(bool enabled):
+	fd_(-1)
+{
+#if defined(__linux__) && defined(SYS_perf_event_open)
+	if (!enabled)
+		return;
+	perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HW_CACHE;
+	attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	attr.inherit = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	fd_ = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+}
+
+DtlbMissCounter::~DtlbMissCounter()
+{
+#ifdef __linux__
+	if (fd_ >= 0)
+		close(fd_);
+#endif
+}
+
+int64_t DtlbMissCounter::get() const
+{
+#ifdef __linux__
+	uint64_t n;
+	if (fd_ >= 0 && read(fd_, &n, sizeof(n)) == sizeof(n))
+		return (int64_t)n;
+#endif
+	return -1;
+}
+
+void DtlbMissCounter::report(const char *stage, Message_stream &stream) const
+{
+	const int64_t n = get();
+	stream << "dTLB load misses (" << stage << ") = ";
+	if (n >= 0)
+		stream << n;
+	else
+		stream << "n/a";
+	stream << ", huge pages = " << (config.huge_pages ? "on" : "off") << std::endl;
+}
@@ -0,0 +1,52 @@
+/****
+DIAMOND protein aligner
+Copyright (C) 2013-2019 Benjamin Buchfink <buchfink@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+****/
+
+#ifndef UTIL_SYSTEM_HUGE_PAGES_H_
+#define UTIL_SYSTEM_HUGE_PAGES_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct Message_stream;
+
+namespace HugePages {
+
+// Asks the kernel to back the 2 MB aligned parts of [ptr, ptr+size) with transparent huge
+// pages if config.huge_pages is set. This only takes effect for pages that have not been
+// touched yet, so it should be called right after allocating a buffer. Does nothing on
+// systems without madvise(MADV_HUGEPAGE) or if the kernel refuses, in which case the
+// buffer keeps using regular pages.
+void advise(void *ptr, size_t size);
+
+}
+
+// Counts the dTLB load misses of the calling thread and of the threads it starts while the
+// counter exists, using perf_event_open on Linux.
+struct DtlbMissCounter
+{
+	explicit DtlbMissCounter(bool enabled = true);
+	~DtlbMissCounter();
+	// Returns the number of misses so far, or -1 if the counter is not available.
+	int64_t get() const;
+	// Writes the number of misses to the stream.
+	void report(const char *stage, Message_stream &stream) const;
+private:
+	int fd_;
+};
+
+#endif
@@ -0,0 +1,158 @@
+/****
+DIAMOND protein aligner
+Copyright (C) 2013-2019 Benjamin Buchfink <buchfink@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+****/
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "numa.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+using std::string;
+using std::vector;
+
+namespace Numa {
+
+// Memory policy constants of the mbind system call, as defined in numaif.h.
+static const int MPOL_PREFERRED_ = 1;
+static const unsigned MPOL_MF_MOVE_ = 1 << 1;
+
+struct Node
+{
+	unsigned id;
+	vector<unsigned> cpus;
+};
+
+// Parses a CPU list like "0-3,8-11".
+static vector<unsigned> parse_cpu_list(const string &s)
+{
+	vector<unsigned> cpus;
+	std::istringstream in(s);
+	string item;
+	while (std::getline(in, item, ',')) {
+		unsigned first, last;
+		const size_t dash = item.find('-');
+		if (item.empty() || item[0] < '0' || item[0] > '9')
+			continue;
+		first = (unsigned)std::stoul(item.substr(0, dash));
+		last = dash == string::npos ? first : (unsigned)std::stoul(item.substr(dash + 1));
+		for (unsigned i = first; i <= last; ++i)
+			cpus.push_back(i);
+	}
+	return cpus;
+}
+
+static vector<Node> read_topology()
+{
+	vector<Node> nodes;
+#ifdef __linux__
+	for (unsigned id = 0, missing = 0; missing < 64; ++id) {
+		std::ifstream f("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+		string line;
+		if (!f || !std::getline(f, line)) {
+			++missing;
+			continue;
+		}
+		missing = 0;
+		Node n;
+		n.id = id;
+		n.cpus = parse_cpu_list(line);
+		if (!n.cpus.empty())
+			nodes.push_back(n);
+	}
+#endif
+	if (nodes.empty())
+		nodes.push_back(Node{ 0, vector<unsigned>() });
+	return nodes;
+}
+
+static const vector<Node>& topology()
+{
+	static const vector<Node> nodes = read_topology();
+	return nodes;
+}
+
+unsigned nodes()
+{
+	return (unsigned)topology().size();
+}
+
+unsigned thread_node(size_t i, size_t n)
+{
+	return (unsigned)(i * nodes() / n);
+}
+
+size_t split(size_t begin, size_t end, unsigned node)
+{
+	return begin + (end - begin) * node / nodes();
+}
+
+void pin_thread(unsigned node)
+{
+#ifdef __linux__
+	const vector<unsigned> &cpus = topology()[node].cpus;
+	if (cpus.empty())
+		return;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (unsigned c : cpus)
+		CPU_SET(c, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+void bind(void *ptr, size_t size, unsigned node)
+{
+#if defined(__linux__) && defined(SYS_mbind)
+	const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	const size_t begin = ((size_t)ptr + page - 1) / page * page, end = ((size_t)ptr + size) / page * page;
+	if (end <= begin || nodes() < 2)
+		return;
+	const unsigned id = topology()[node].id;
+	vector<unsigned long> mask(id / (8 * sizeof(unsigned long)) + 1, 0);
+	mask[id / (8 * sizeof(unsigned long))] = 1ul << (id % (8 * sizeof(unsigned long)));
+	// Placement is an optimization, so failures are ignored.
+	syscall(SYS_mbind, begin, end - begin, MPOL_PREFERRED_, mask.data(), mask.size() * 8 * sizeof(unsigned long) + 1, MPOL_MF_MOVE_);
+#endif
+}
+
+Counters Counters::get()
+{
+	Counters c{ 0, 0 };
+#ifdef __linux__
+	for (const Node &n : topology()) {
+		std::ifstream f("/sys/devices/system/node/node" + std::to_string(n.id) + "/numastat");
+		string key;
+		uint64_t value;
+		while (f >> key >> value)
+			if (key == "local_node")
+				c.local += value;
+			else if (key == "other_node")
+				c.remote += value;
+	}
+#endif
+	return c;
+}
+
+}
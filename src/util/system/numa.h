@@ -0,0 +1,52 @@
+/****
+DIAMOND protein aligner
+Copyright (C) 2013-2019 Benjamin Buchfink <buchfink@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+****/
+
+#ifndef UTIL_SYSTEM_NUMA_H_
+#define UTIL_SYSTEM_NUMA_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// NUMA topology and placement, read from sysfs and applied with mbind and thread
+// affinities on Linux. On other systems a single node is reported and placement does
+// nothing.
+namespace Numa {
+
+// Number of NUMA nodes that have CPUs.
+unsigned nodes();
+// Node of worker thread i out of n, so that the threads are spread evenly over the nodes.
+unsigned thread_node(size_t i, size_t n);
+// First element of the share of a node when [begin, end) is split evenly over the nodes.
+size_t split(size_t begin, size_t end, unsigned node);
+// Restricts the calling thread to the CPUs of a node.
+void pin_thread(unsigned node);
+// Places the pages that lie completely within [ptr, ptr+size) on a node. Pages that are
+// already present elsewhere are moved.
+void bind(void *ptr, size_t size, unsigned node);
+
+// Page allocations of the system that were satisfied on the node of the allocating CPU
+// (local) or on another node (remote), summed over all nodes.
+struct Counters
+{
+	static Counters get();
+	uint64_t local, remote;
+};
+
+}
+
+#endif